@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <avr/eeprom.h>
+#include "aid.h"
+#include "ubx.h"
+#include "gps.h"
+#include "uart1.h"
+#include "fat16.h"
+#include "crc16.h"
+#include "timer0.h"
+#include "fifo.h"
+#include "printf_P.h"
+
+// almanac and ephemeris messages of the receiver, a new poll is written to the other file
+// and the eeprom selects the last complete one
+#define AID_FILENAME0		"gpsaid0.dat"
+#define AID_FILENAME1		"gpsaid1.dat"
+#define AID_STORE_LEN		512			// the answers are buffered until they are written by Aid_Update()
+#define AID_FRAME_MAX		(UBX_AID_MAXLEN + 8)
+#define AID_SAVE_INTERVAL	60000L		// in ms, check if the position has to be stored
+#define AID_POS_MOVED		100000L		// in 1e-7 deg, store the position if it differs by about 1 km
+#define AID_POS_ACCURACY	10000000L	// in cm, the receiver may have been moved while it was off
+#define AID_POLL_DELAY		300000L		// in ms after the first fix, the receiver has decoded the ephemeris then
+#define AID_POLL_INTERVAL	1800000L	// in ms
+#define AID_POLL_TIME		5000		// in ms, time for the answers of the receiver
+#define AID_CARD_TIMEOUT	10000L		// in ms after power on, wait that long for the card to replay the stored messages
+
+// the last good position, the board has no rtc therefore the time is not stored
+typedef struct
+{
+	int32_t		Latitude;	// in 1e-7 deg
+	int32_t		Longitude;	// in 1e-7 deg
+	int32_t		Altitude;	// in cm
+	uint16_t	CRC;
+} __attribute__((packed)) AidPos_t;
+
+AidPos_t EEMEM EE_AidPos;
+uint8_t EEMEM EE_AidFile;	// index of the file with the last complete set of messages
+
+typedef enum
+{
+	AID_INIT,		// wait for the configuration of the receiver
+	AID_OPEN,		// wait for the card to replay the stored messages
+	AID_REPLAY,		// send the stored messages to the receiver
+	AID_IDLE,
+	AID_POLL		// the receiver sends its almanac and ephemeris
+} AidState_t;
+
+AidState_t AidState = AID_INIT;
+File_t *Aid_File = NULL;
+uint8_t Aid_Frame[AID_FRAME_MAX];	// the message to be sent to the receiver
+uint8_t Aid_FrameLen = 0;
+Timer_t Aid_SaveTimer, Aid_PollTimer;
+uint8_t Aid_PollRequest = 0;	// set by the poll timer
+fifo_t Aid_StoreFifo;			// answers of the receiver that have to be written to the card
+uint8_t Aid_StoreBuffer[AID_STORE_LEN];
+uint8_t Aid_StoreIndex = 0;		// index of the file that is written
+uint8_t Aid_StoreFrames = 0;	// number of messages written to the file
+uint8_t Aid_StoreError = 0;		// a message has been lost, the file is not used
+
+uint16_t Aid_TTFF = 0;
+uint8_t  Aid_Flags = 0;
+uint8_t  Aid_Frames = 0;
+
+/********************************************************/
+/*       Send the stored position to the receiver       */
+/********************************************************/
+void Aid_SendPosition(void)
+{
+	AidPos_t pos;
+	uint8_t payload[48];
+	uint8_t i;
+
+	eeprom_read_block(&pos, &EE_AidPos, sizeof(AidPos_t));
+	if(pos.CRC != CRC16((uint8_t *)&pos, sizeof(AidPos_t) - sizeof(pos.CRC))) return; // nothing stored
+
+	for(i = 0; i < sizeof(payload); i++) payload[i] = 0;
+	*(int32_t *)&payload[0]  = pos.Latitude;
+	*(int32_t *)&payload[4]  = pos.Longitude;
+	*(int32_t *)&payload[8]  = pos.Altitude;
+	*(uint32_t *)&payload[12] = AID_POS_ACCURACY;
+	payload[44] = 0x21; // position is valid and given as latitude, longitude and altitude
+	UBX_SendMessage(UBX_CLASS_AID, UBX_ID_AID_INI, payload, sizeof(payload));
+	Aid_Flags |= AID_POSITION;
+}
+
+/********************************************************/
+/*   Store the current position if it has been changed  */
+/********************************************************/
+void Aid_SavePosition(void)
+{
+	AidPos_t pos;
+
+	if(GPS_Tracker.Status == INVALID) return; // no fix
+	eeprom_read_block(&pos, &EE_AidPos, sizeof(AidPos_t));
+	if((pos.CRC == CRC16((uint8_t *)&pos, sizeof(AidPos_t) - sizeof(pos.CRC))) &&
+	   (labs(pos.Latitude - GPSData.Position.Latitude) < AID_POS_MOVED) &&
+	   (labs(pos.Longitude - GPSData.Position.Longitude) < AID_POS_MOVED)) return; // save the eeprom
+	pos.Latitude = GPSData.Position.Latitude;
+	pos.Longitude = GPSData.Position.Longitude;
+	pos.Altitude = GPSData.Position.Altitude / 10; // mm -> cm
+	pos.CRC = CRC16((uint8_t *)&pos, sizeof(AidPos_t) - sizeof(pos.CRC));
+	eeprom_write_block(&pos, &EE_AidPos, sizeof(AidPos_t));
+}
+
+// called by the poll timer
+static void Aid_Poll(void)
+{
+	Aid_PollRequest = 1;
+}
+
+// returns the name of the file with the index 0 or 1
+static int8_t *Aid_FileName(uint8_t index)
+{
+	return((int8_t *)(index ? AID_FILENAME1 : AID_FILENAME0));
+}
+
+// returns the index of the file with the last complete set of messages
+static uint8_t Aid_ValidFile(void)
+{
+	return(eeprom_read_byte(&EE_AidFile) == 1); // an erased eeprom selects file 0
+}
+
+/********************************************************/
+/*      Read the next stored message from the card      */
+/********************************************************/
+uint8_t Aid_ReadFrame(void)
+{
+	uint16_t len;
+
+	if(fread_(Aid_Frame, 6, 1, Aid_File) != 1) return(0);
+	len = Aid_Frame[4] | ((uint16_t)Aid_Frame[5] << 8);
+	if((Aid_Frame[0] != 0xB5) || (Aid_Frame[1] != 0x62) || (len > AID_FRAME_MAX - 8)) return(0);
+	if(fread_(&Aid_Frame[6], len + 2, 1, Aid_File) != 1) return(0);
+	Aid_FrameLen = len + 8;
+	return(1);
+}
+
+/********************************************************/
+/*  Buffer an almanac or ephemeris message for the card */
+/********************************************************/
+// Called by the ubx parser, the message is written to the card later by Aid_Update()
+// to keep the parser from stalling on a card access.
+void Aid_Store(uint8_t id, const uint8_t *pData, uint16_t len)
+{
+	uint8_t header[6];
+	uint8_t cka = 0, ckb = 0;
+	uint8_t i;
+
+	if((AidState != AID_POLL) || (Aid_File == NULL)) return;
+	if(len <= 8) return; // the receiver has no data for this satellite
+	if(fifo_space(&Aid_StoreFifo) < len + 8)
+	{
+		Aid_StoreError = 1;
+		return;
+	}
+	header[0] = 0xB5;
+	header[1] = 0x62;
+	header[2] = UBX_CLASS_AID;
+	header[3] = id;
+	header[4] = (uint8_t)len;
+	header[5] = (uint8_t)(len >> 8);
+	for(i = 2; i < 6; i++) { cka += header[i]; ckb += cka; }
+	for(i = 0; i < len; i++) { cka += pData[i]; ckb += cka; }
+	fifo_put_bulk(&Aid_StoreFifo, header, 6);
+	fifo_put_bulk(&Aid_StoreFifo, pData, len);
+	fifo_put(&Aid_StoreFifo, cka);
+	fifo_put(&Aid_StoreFifo, ckb);
+	Aid_StoreFrames++;
+}
+
+// writes the buffered messages to the card
+static void Aid_WriteStored(void)
+{
+	uint8_t *pdata;
+	uint16_t len;
+
+	while((len = fifo_get_span(&Aid_StoreFifo, &pdata)) != 0)
+	{
+		if(fwrite_(pdata, len, 1, Aid_File) != 1) Aid_StoreError = 1;
+		fifo_release(&Aid_StoreFifo, len);
+	}
+}
+
+/********************************************************/
+/*          Aiding of the gps receiver                  */
+/********************************************************/
+// Has to be called periodically from the main loop.
+// After the configuration of the receiver the stored position and the stored almanac and ephemeris
+// are sent to the receiver. While the receiver has a fix, its position is stored in the eeprom
+// and its almanac and ephemeris are polled and stored on the card from time to time.
+void Aid_Update(void)
+{
+	static uint16_t Aid_PollTime = 0;
+	uint8_t index;
+
+	// time to first fix
+	if(!Aid_TTFF && (GPS_Tracker.Status != INVALID))
+	{
+		Aid_TTFF = (uint16_t)(GetMilliseconds() / 1000);
+		if(!Aid_TTFF) Aid_TTFF = 1;
+		if(Aid_Frames) Aid_Flags |= AID_ORBITS;
+		printf("\r\n GPS: first fix after %us", Aid_TTFF);
+		Aid_SavePosition();
+		Timer_Start(&Aid_SaveTimer, AID_SAVE_INTERVAL, AID_SAVE_INTERVAL, Aid_SavePosition);
+		Timer_Start(&Aid_PollTimer, AID_POLL_DELAY, AID_POLL_INTERVAL, Aid_Poll);
+	}
+
+	switch(AidState)
+	{
+		case AID_INIT:
+			if(!UbxConfigured) break;
+			fifo_init(&Aid_StoreFifo, Aid_StoreBuffer, AID_STORE_LEN);
+			Aid_SendPosition();
+			AidState = AID_OPEN;
+			break;
+
+		case AID_OPEN:
+			if(Aid_TTFF || (GetMilliseconds() > AID_CARD_TIMEOUT)) AidState = AID_IDLE; // too late
+			else if(Fat16_IsValid())
+			{
+				Aid_File = NULL;
+				index = Aid_ValidFile();
+				if(fexist_(Aid_FileName(index))) Aid_File = fopen_(Aid_FileName(index), 'r');
+				if(Aid_File == NULL) AidState = AID_IDLE;
+				else
+				{
+					Aid_FrameLen = 0;
+					AidState = AID_REPLAY;
+				}
+			}
+			break;
+
+		case AID_REPLAY:
+			if(!Aid_FrameLen && !Aid_ReadFrame())
+			{	// all messages sent
+				fclose_(Aid_File);
+				Aid_File = NULL;
+				AidState = AID_IDLE;
+			}
+			else if(USART1_Write(Aid_Frame, Aid_FrameLen))
+			{
+				Aid_FrameLen = 0;
+				Aid_Frames++;
+			}
+			break;
+
+		case AID_IDLE:
+			if(!Aid_PollRequest || (GPS_Tracker.Status == INVALID) || !Fat16_IsValid()) break;
+			Aid_PollRequest = 0;
+			// the last complete file is kept until the new one is complete
+			Aid_StoreIndex = !Aid_ValidFile();
+			Aid_File = fopen_(Aid_FileName(Aid_StoreIndex), 'w');
+			if(Aid_File == NULL) break;
+			fifo_purge(&Aid_StoreFifo);
+			Aid_StoreFrames = 0;
+			Aid_StoreError = 0;
+			UBX_SendMessage(UBX_CLASS_AID, UBX_ID_AID_ALM, NULL, 0);
+			UBX_SendMessage(UBX_CLASS_AID, UBX_ID_AID_EPH, NULL, 0);
+			Aid_PollTime = SetDelay(AID_POLL_TIME);
+			AidState = AID_POLL;
+			break;
+
+		case AID_POLL:
+			Aid_WriteStored();
+			if(!CheckDelay(Aid_PollTime)) break;
+			// use the new file only if all answers have been written
+			if((fclose_(Aid_File) == 0) && Aid_StoreFrames && !Aid_StoreError)
+			{
+				eeprom_write_byte(&EE_AidFile, Aid_StoreIndex);
+			}
+			Aid_File = NULL;
+			AidState = AID_IDLE;
+			break;
+
+		default:
+			AidState = AID_IDLE;
+			break;
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef _AID_H
+#define _AID_H
+
+#include <inttypes.h>
+
+// the first fix of the receiver has been aided by
+#define AID_POSITION	0x01	// the stored position
+#define AID_ORBITS		0x02	// the stored almanac and ephemeris
+
+extern uint16_t Aid_TTFF;		// time to first fix after power on in s, 0 until the first fix
+extern uint8_t  Aid_Flags;		// aiding used for the first fix
+extern uint8_t  Aid_Frames;		// number of almanac and ephemeris messages sent to the receiver
+
+void Aid_Update(void);
+// stores an almanac or ephemeris message received from the gps
+void Aid_Store(uint8_t id, const uint8_t *pData, uint16_t len);
+
+#endif //_AID_H
@@ -5,8 +5,20 @@
 #include "analog.h"
 #include "printf_P.h"
 
-volatile uint16_t Adc0, Adc1, Adc2, Adc3, Adc4, Adc5, Adc6, Adc7;
-volatile uint8_t ADReady = 1;
+// The conversions are started by ADC_Sample() in the 1 ms interrupt of timer0. A conversion takes 208 us,
+// therefore its result is read at the next tick and the adc needs no interrupt of its own, that would wake
+// up the cpu from the idle sleep a second time every ms.
+// The channels are converted one after the other, ADC_OVERSAMPLE samples of a channel are summed up
+// and the sum is fed into a first order iir filter. Therefore every channel is filtered at a fixed rate
+// of 1000 / ADC_CHANNELS / ADC_OVERSAMPLE = 31.25 Hz independent of the load of the main loop.
+#define ADC_OVERSAMPLE		4	// samples per filter update, has to be a power of 2 <= 16
+#define ADC_FILTER_SHIFT	2	// y += (x - y) / 2^ADC_FILTER_SHIFT, time constant about 4 updates or 128 ms
+
+static uint16_t Adc_Sum[ADC_CHANNELS];				// sum of the samples of the current filter period
+static volatile uint16_t Adc_Filter[ADC_CHANNELS];	// filter output in 1/16 LSB
+static uint8_t Adc_Channel = 0;						// channel of the running conversion
+static uint8_t Adc_Round = 0;						// number of completed rounds over all channels
+volatile uint8_t ADC_Valid = 0;						// set after the first filter update of all channels
 
 /*****************************************************/
 /*     Initialize Analog Digital Converter           */
@@ -14,6 +26,7 @@ volatile uint8_t ADReady = 1;
 void ADC_Init(void)
 {
 	uint8_t sreg = SREG;
+	uint8_t i;
 	printf("\r\n ADC init...");
 	// disable all interrupts before reconfiguration
 	cli();
@@ -23,90 +36,82 @@ void ADC_Init(void)
 	// Digital Input Disable Register 0
 	// Disable digital input buffer for analog adc_channel pins
 	DIDR0 = 0xFF;
+	for(i = 0; i < ADC_CHANNELS; i++)
+	{
+		Adc_Sum[i] = 0;
+		Adc_Filter[i] = 0;
+	}
+	Adc_Channel = 0;
+	Adc_Round = 0;
+	ADC_Valid = 0;
 	// external reference AREF, adjust data to the right
     ADMUX &= ~((1 << REFS1)|(1 << REFS0)|(1 << ADLAR));
     // set muxer to ADC adc_channel 0 (0 to 7 is a valid choice)
     ADMUX = (ADMUX & 0xE0) | 0x00;
     //Set ADC Control and Status Register A
-    //Auto Trigger Enable, Prescaler Select Bits to Division Factor 128, i.e. ADC clock = SYSCKL/128 = 156.25 kHz
-  	ADCSRA = (0<<ADEN)|(0<<ADSC)|(0<<ADATE)|(1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0)|(0<<ADIE);
-	//Set ADC Control and Status Register B
-	//Trigger Source to Free Running Mode
-	ADCSRB &= ~((1 << ADTS2)|(1 << ADTS1)|(1 << ADTS0));
-	// Start AD conversion
-	ADC_Enable();
+    //Start the first conversion, no Auto Trigger, no Interrupt,
+    //Prescaler Select Bits to Division Factor 128, i.e. ADC clock = SYSCKL/128 = 62.5 kHz
+	//a conversion takes 13 ADC clocks or 208 us, the first one 25 ADC clocks or 400 us
+  	ADCSRA = (1<<ADEN)|(1<<ADSC)|(0<<ADATE)|(1<<ADIF)|(1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0)|(0<<ADIE);
     // restore global interrupt flags
     SREG = sreg;
 	sei();
     printf("ok");
 }
 
+// -----------------------------------------------------------------------
+// returns the filtered value of a channel in 1/16 LSB, i.e. 0 ... 16368
+uint16_t ADC_GetValue(uint8_t channel)
+{
+	uint8_t sreg = SREG;
+	uint16_t value;
+
+	if(channel >= ADC_CHANNELS) return(0);
+	cli();
+	value = Adc_Filter[channel];
+	SREG = sreg;
+	return(value);
+}
+
 /*****************************************************/
-/*     Interrupt Service Routine for ADC             */
+/*     Sample the ADC from the timer interrupt       */
 /*****************************************************/
-// runs at 312.5 kHz or 3.2 s
-// if after (60.8s) all 19 states are processed the interrupt is disabled
-// and the update of further ads is stopped
-
+// called 1000 times per second by the interrupt of timer0,
+// reads the conversion started at the last tick and starts the next one
+void ADC_Sample(void)
+{
+	uint8_t channel = Adc_Channel;
+	uint16_t sum;
+	int16_t x, y;
 
-#define ADC0	0
-#define ADC1	1
-#define ADC2	2
-#define ADC3	3
-#define ADC4	4
-#define ADC5	5
-#define ADC6	6
-#define ADC7	7
+	// not initialized yet or the conversion is still running
+	if(!(ADCSRA & (1<<ADEN)) || (ADCSRA & (1<<ADSC))) return;
 
-ISR(ADC_vect)
-{
-    static uint8_t ad_channel = ADC0, state = 0;
+	sum = Adc_Sum[channel] + ADC;
+	// switch the muxer and start the conversion of the next channel
+	if(++Adc_Channel >= ADC_CHANNELS) Adc_Channel = 0;
+	ADMUX = (ADMUX & 0xE0) | Adc_Channel;
+	ADCSRA |= (1<<ADSC);
 
-    // state machine
-	switch(state++)
+	if(Adc_Round < ADC_OVERSAMPLE - 1)
+	{
+		Adc_Sum[channel] = sum;
+	}
+	else
+	{	// decimate and filter, the sum is scaled to 1/16 LSB
+		Adc_Sum[channel] = 0;
+		x = (int16_t)(sum * (16 / ADC_OVERSAMPLE));
+		y = (int16_t)Adc_Filter[channel];
+		if(!ADC_Valid) y = x; // start the filter with the first value
+		else y += (x - y) >> ADC_FILTER_SHIFT;
+		Adc_Filter[channel] = (uint16_t)y;
+	}
+	if(Adc_Channel == 0) // round completed
 	{
-		case 0:
-			Adc0 = ADC;
-			ad_channel = ADC1;
-			break;
-		case 1:
-			Adc1 = ADC;
-			ad_channel = ADC2;
-			break;
-		case 2:
-			Adc2 = ADC;
-			ad_channel = ADC3;
-			break;
-		case 3:
-			Adc3 = ADC;
-			ad_channel = ADC4;
-            break;
-		case 4:
-			Adc4 = ADC;
-			ad_channel = ADC5;
-			break;
-		case 5:
-			Adc5 = ADC;
-			ad_channel = ADC6;
-			break;
-		case 6:
-			Adc6 = ADC;
-			ad_channel = ADC7;
-			break;
-		case 7:
-			Adc7 = ADC;
-			ad_channel = ADC0;
-			state = 0;
-			ADReady = 1;
-            break;
-		default:
-			ad_channel = ADC0;
-			state = 0;
-			ADReady = 1;
-			break;
+		if(++Adc_Round >= ADC_OVERSAMPLE)
+		{
+			Adc_Round = 0;
+			ADC_Valid = 1;
+		}
 	}
-    // set adc muxer to next ad_channel
-    ADMUX = (ADMUX & 0xE0) | ad_channel;
-    // after full cycle stop further interrupts
-    if(state != 0) ADC_Enable();
 }
@@ -3,18 +3,16 @@
 
 #include <inttypes.h>
 
-extern volatile uint16_t Adc0, Adc1, Adc2, Adc3, Adc4, Adc5, Adc6, Adc7;
-extern volatile uint8_t ADReady;
+#define ADC_CHANNELS	8
 
-void ADC_Init(void);
-
-
-// clear ADC enable & ADC Start Conversion & ADC Interrupt Enable bit
-#define ADC_Disable() (ADCSRA &= ~((1<<ADEN)|(1<<ADSC)|(1<<ADIE)))
-// set ADC enable & ADC Start Conversion & ADC Interrupt Enable bit
-#define ADC_Enable() (ADCSRA |= (1<<ADEN)|(1<<ADSC)|(1<<ADIE))
+// the channels are sampled and filtered in the background, set after the first filter output of all channels
+extern volatile uint8_t ADC_Valid;
 
+void ADC_Init(void);
+// called by the 1 ms interrupt of timer0
+void ADC_Sample(void);
+// filtered value of a channel in 1/16 LSB
+uint16_t ADC_GetValue(uint8_t channel);
 
 #endif //_ANALOG_H
 
-
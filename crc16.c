@@ -42,7 +42,7 @@ uint16_t CRC16(const uint8_t *pBuffer, uint32_t len)
 	uint32_t counter;
 	uint16_t crc = 0;
 	for( counter = 0; counter < len; counter++)
-		crc = (crc<<8) ^ crc16tab[((crc>>8) ^ *pBuffer++)&0x00FF];
+		crc = CRC16_UPDATE(crc, *pBuffer++);
 	return crc;
 }
 
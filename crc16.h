@@ -2,6 +2,12 @@
 #define _CRC16_H
 
 #include <inttypes.h>
+#include <avr/pgmspace.h>
+
+extern const uint16_t crc16tab[256];
+
+// updates the crc16 (polynom 0x1021) by one data byte
+#define CRC16_UPDATE(crc, data)	(((crc)<<8) ^ pgm_read_word(&crc16tab[(((crc)>>8) ^ (data)) & 0x00FF]))
 
 extern uint16_t CRC16(const uint8_t * pBuffer, uint32_t len);
 
@@ -1,8 +1,10 @@
+#include <avr/io.h>
 #include <string.h>
 #include "printf_P.h"
 #include "timer0.h"
 #include "fat16.h"
 #include "sdc.h"
+#include "ssc.h"
 #include "uart1.h"
 
 
@@ -198,6 +200,20 @@ typedef struct
 
 #define	FSTATE_UNUSED	0
 #define	FSTATE_USED		1
+#define	FSTATE_INVALID	2		// the card has been removed while the file was open, the handle has to be closed by the user
+
+#define FAT16_DEBOUNCE_TIME		200		// ms the card switch has to be stable before the card is initialized
+#define FAT16_RETRY_TIME		5000	// ms to wait before a failed card is initialized again
+
+// states of the card monitor
+typedef enum
+{
+	CARD_REMOVED,
+	CARD_DEBOUNCE,
+	CARD_INIT,
+	CARD_MOUNTED,
+	CARD_ERROR
+} CardState_t;
 
 typedef struct
 {
@@ -216,6 +232,9 @@ Partition_t 	Partition;					// Structure holds partition information
 
 File_t FilePointer[FILE_MAX_OPEN];	// Allocate Memmoryspace for each filepointer used.
 
+CardState_t		CardState = CARD_REMOVED;	// state of the card monitor
+uint16_t		CardTimer = 0;				// debounce and retry timer of the card monitor
+
 
 /****************************************************************************************************************************************/
 /*	Function: 		FileDateTime(DateTime_t *);																							*/
@@ -286,6 +305,7 @@ uint8_t UnlockFilePointer(File_t * file)
 			file->ByteOfCurrSector			= 0;			// The bytelocation within the current sector (cluster_pointer + sector_index + byte_index).
 			file->Mode 						= 0;			// mode of fileoperation (read,write)
 			file->Size 						= 0;			// the size of the opend file in bytes.
+			file->DateTime 					= 0;			// the date time of the last write access to the file.
 			file->Position 					= 0;			// pointer to a character within the file 0 < fileposition < filesize
 			file->SectorInCache 			= 0;			// the last sector read, wich is still in the sectorbuffer.
 			file->DirectorySector 			= 0;			// the sectorposition where the directoryentry has been made.
@@ -419,47 +439,53 @@ uint8_t Fat16_Deinit(void)
 }
 
 /****************************************************************************************************************************************/
-/*	Function: 		Fat16_Init(void);																									*/
+/*	Function: 		Fat16_Invalidate(void);																								*/
 /*																																	    */
-/*	Description:	This function reads the Masterbootrecord and finds the position of the Volumebootrecord, the FAT and the Rootdir    */
-/*					and stores the information in global variables.																	    */
+/*	Description:	This function is called if the card has been removed from the slot. The open files can not be written back anymore, */
+/*					therefore the filepointers are marked as invalid and have to be released by the user calling fclose_().			*/
 /*																																	    */
-/*	Returnvalue: 	The function returns "0" if the filesystem is initialized.															*/
+/*	Returnvalue: 	none																												*/
 /****************************************************************************************************************************************/
-uint8_t Fat16_Init(void)
+void Fat16_Invalidate(void)
+{
+	uint8_t cnt;
+
+	for(cnt = 0; cnt < FILE_MAX_OPEN; cnt++)
+	{
+		if(FilePointer[cnt].State == FSTATE_USED)
+		{
+			FilePointer[cnt].State = FSTATE_INVALID;	// the data in the cache is lost
+			FilePointer[cnt].SectorInCache = 0;
+		}
+	}
+	SDC_Deinit();			// uninitialize interface to sd-card
+	Partition.IsValid = 0;	// mark data in partition structure as invalid
+}
+
+/****************************************************************************************************************************************/
+/*	Function: 		Fat16_Mount(void);																									*/
+/*																																	    */
+/*	Description:	This function reads the Masterbootrecord of the initialized sd-card and finds the position of the Volumebootrecord, */
+/*					the FAT and the Rootdir and stores the information in global variables.												*/
+/*																																	    */
+/*	Returnvalue: 	The function returns "0" if the filesystem is mounted.																*/
+/****************************************************************************************************************************************/
+uint8_t Fat16_Mount(void)
 {
-    uint8_t	cnt	= 0;
 	uint32_t	partitionfirstsector;
 	VBR_Entry_t *VBR;
 	MBR_Entry_t *MBR;
 	File_t *file;
-	uint8_t result = 0;
 
-	printf("\r\n FAT16 init...");
 	Partition.IsValid = 0;
-
-	// declare the filepointers as unused.
-	for(cnt = 0; cnt < FILE_MAX_OPEN; cnt++)
-	{
-		FilePointer[cnt].State = FSTATE_UNUSED;
-	}
-	// set current file pinter to first position in list
+	// the cache of the first filepointer is used as sector buffer,
+	// no file can be in use while the filesystem is not mounted.
 	file = &FilePointer[0];
 
-	// try to initialise the sd-card.
-	if(SD_SUCCESS != SDC_Init())
-	{
-	 	printf("SD-Card could not be initialized.");
-		result = 1;
-		goto end;
-	}
-
-	// SD-Card is initialized successfully
 	if(SD_SUCCESS != SDC_GetSector((uint32_t)MBR_SECTOR,file->Cache))	// Read the MasterBootRecord
 	{
 		printf("Error reading the MBR.");
-		result = 2;
-		goto end;
+		return(2);
 	}
 	MBR = (MBR_Entry_t *)file->Cache;						// Enter the MBR using the structure MBR_Entry_t.
 	if((MBR->PartitionEntry1.Type == PART_TYPE_FAT16_ST_32_MB) ||
@@ -472,8 +498,7 @@ uint8_t Fat16_Init(void)
 		if(SD_SUCCESS != SDC_GetSector(partitionfirstsector,file->Cache)) // Read the volume boot record
 		{
 			printf("Error reading the VBR.");
-			result = 3;
-			goto end;
+			return(3);
 		}
 	}
 	else  // maybe the medium has no partition assuming sector 0 is the vbr
@@ -485,8 +510,7 @@ uint8_t Fat16_Init(void)
 	if(VBR->BytesPerSector != BYTES_PER_SECTOR)
 	{
 		printf("VBR: Sector size not supported.");
-		result = 4;
-		goto end;
+		return(4);
 	}
 	Partition.SectorsPerCluster		= VBR->SectorsPerCluster;			// Number of sectors per cluster. Depends on the memorysize of the sd-card.
 	Partition.FatCopies 			= VBR->NoFATCopies;					// Number of fatcopies.
@@ -507,25 +531,157 @@ uint8_t Fat16_Init(void)
 	if(VBR->NoSectors == 0)
 	{
 	 	printf("VBR: Bad number of sectors.");
-		result = 5;
-		goto end;
+		return(5);
 	}
 	Partition.LastDataSector = Partition.FirstDataSector + VBR->NoSectors - 1;
 	// check for FAT16 in VBR of first partition
 	if(!((VBR->FATName[0]=='F') && (VBR->FATName[1]=='A') && (VBR->FATName[2]=='T') && (VBR->FATName[3]=='1')&&(VBR->FATName[4]=='6')))
 	{
 		printf("VBR: Partition ist not FAT16 type.");
-		result = 6;
-		goto end;
+		return(6);
 	}
 	Partition.IsValid = 1; // mark data in partition structure as valid
-	result = 0;
-	end:
-	if(result != 0)	Fat16_Deinit();
-	else printf(" ...ok");
+	return(0);
+}
+
+/****************************************************************************************************************************************/
+/*	Function: 		Fat16_Init(void);																									*/
+/*																																	    */
+/*	Description:	This function reads the Masterbootrecord and finds the position of the Volumebootrecord, the FAT and the Rootdir    */
+/*					and stores the information in global variables.																	    */
+/*																																	    */
+/*	Returnvalue: 	The function returns "0" if the filesystem is initialized.															*/
+/****************************************************************************************************************************************/
+uint8_t Fat16_Init(void)
+{
+    uint8_t	cnt	= 0;
+	uint8_t result = 0;
+
+	printf("\r\n FAT16 init...");
+	Partition.IsValid = 0;
+
+	// declare the filepointers as unused.
+	for(cnt = 0; cnt < FILE_MAX_OPEN; cnt++)
+	{
+		FilePointer[cnt].State = FSTATE_UNUSED;
+	}
+
+	// try to initialise the sd-card.
+	if(SD_SUCCESS != SDC_Init())
+	{
+	 	printf("SD-Card could not be initialized.");
+		result = 1;
+	}
+	else
+	{	// SD-Card is initialized successfully
+		result = Fat16_Mount();
+	}
+
+	if(result != 0)
+	{
+		Fat16_Deinit();
+		if(SD_SWITCH)
+		{
+			CardTimer = SetDelay(FAT16_RETRY_TIME);
+			CardState = CARD_ERROR;		// the card monitor retries later
+		}
+		else CardState = CARD_REMOVED;	// the card monitor waits for a card
+	}
+	else
+	{
+		CardState = CARD_MOUNTED;
+		printf(" ...ok");
+	}
 	return(result);
 }
 
+/****************************************************************************************************************************************/
+/*	Function: 		Fat16_Update(void);																									*/
+/*																																	    */
+/*	Description:	This function has to be called periodically from the main loop. It monitors the card switch, releases the			*/
+/*					filesystem if the card is removed and mounts a new inserted card step by step without blocking the caller.			*/
+/*					A card that could not be mounted or that has been unmounted after an error is retried every 5 seconds.				*/
+/*																																	    */
+/*	Returnvalue: 	The function returns "1" if a card has been mounted during this call, otherwise "0".								*/
+/****************************************************************************************************************************************/
+uint8_t Fat16_Update(void)
+{
+	SD_Result_t result;
+	uint8_t mounted = 0;
+
+	if(!SD_SWITCH) // no card in slot
+	{
+		switch(CardState)
+		{
+			case CARD_REMOVED:
+				break;
+			case CARD_DEBOUNCE: // card has not been mounted yet
+				CardState = CARD_REMOVED;
+				break;
+			default:
+				printf("\r\n SD-Card removed.");
+				Fat16_Invalidate();
+				CardState = CARD_REMOVED;
+				break;
+		}
+		return(mounted);
+	}
+
+	switch(CardState)
+	{
+		case CARD_REMOVED: // a card has been inserted
+			CardTimer = SetDelay(FAT16_DEBOUNCE_TIME);
+			CardState = CARD_DEBOUNCE;
+			break;
+
+		case CARD_DEBOUNCE: // wait until the card switch is stable
+		case CARD_ERROR: // wait for the next retry
+			if(CheckDelay(CardTimer))
+			{
+				printf("\r\n FAT16 init...");
+				Fat16_Invalidate();	// release the files of the last mount
+				if(SD_PENDING == SDC_InitStart()) CardState = CARD_INIT;
+				else
+				{
+					CardTimer = SetDelay(FAT16_RETRY_TIME);
+					CardState = CARD_ERROR;
+				}
+			}
+			break;
+
+		case CARD_INIT: // one step of the card initialisation per call
+			result = SDC_InitStep();
+			if(result == SD_PENDING) break;
+			if((result == SD_SUCCESS) && (Fat16_Mount() == 0))
+			{
+				printf(" ...ok");
+				CardState = CARD_MOUNTED;
+				mounted = 1;
+			}
+			else
+			{
+				printf("SD-Card could not be initialized.");
+				SDC_Deinit();
+				CardTimer = SetDelay(FAT16_RETRY_TIME);
+				CardState = CARD_ERROR;
+			}
+			break;
+
+		case CARD_MOUNTED:
+			if(!Partition.IsValid) // the filesystem has been released after an error
+			{
+				CardTimer = SetDelay(FAT16_RETRY_TIME);
+				CardState = CARD_ERROR;
+			}
+			break;
+
+		default:
+			CardState = CARD_REMOVED;
+			break;
+	}
+	return(mounted);
+}
+
 /****************************************************************************************************************************************/
 /*	Function: 	Fat16_IsValid(void);																									   	*/
 /*																																	   	*/
@@ -683,7 +839,7 @@ int16_t fseek_(File_t * const file, int32_t offset, int16_t origin)
 	int32_t		fposition 	= 0;
 	int16_t 	retvalue 	= 1;
 
-	if((!Partition.IsValid) || (file == NULL)) return(0);
+	if((!Partition.IsValid) || (file == NULL) || (file->State != FSTATE_USED)) return(0);
 	switch(origin)
 	{
 		case SEEK_SET:				// Fileposition relative to the beginning of the file.
@@ -954,6 +1110,7 @@ uint8_t DirectoryEntryExist(int8_t *dirname, uint8_t attribfilter, uint8_t attri
 						file->DirectorySector = curr_sector; // current sector
 						file->DirectoryIndex  = dir_entry; // current direntry in current sector
 						file->Size = dir[dir_entry].Size;
+						file->DateTime = dir[dir_entry].DateTime;
 						direntry_exist = 1; // mark as found
 						dir_entry = DIRENTRIES_PER_SECTOR;	// stop for-loop
 				} // end of first byte of name check
@@ -1082,6 +1239,7 @@ uint8_t CreateDirectoryEntry(int8_t *dirname, uint8_t attrib, File_t *file)
 						file->ByteOfCurrSector 			= 0;								// reset the byte location within the current sector
 						file->Attribute 				= attrib;  	    					// set file attribute to dir attribute
 						file->Size 						= 0;							    // new file has no size
+						file->DateTime 					= dir[dir_entry].DateTime;			// date time of creation
 						file->DirectorySector 			= curr_sector;
 						file->DirectoryIndex  			= dir_entry;
 						if((attrib & ATTR_SUBDIRECTORY) == ATTR_SUBDIRECTORY) 				// if a new directory was created then initilize the data area
@@ -1259,6 +1417,35 @@ uint8_t FileCreate(const int8_t* filename, const uint8_t attrib, File_t *file)
 }
 
 
+/****************************************************************************************************************************************/
+/*	Function: 		SetStartCluster(File_t *file, uint16_t cluster);																	*/
+/*																																	  	*/
+/*	Description:	This function enters the first cluster of an existing file into its directory entry and sets the file size to 0.	*/
+/*																																	   	*/
+/*	Returnvalue: 	1 on success, 0 on error.																							*/
+/****************************************************************************************************************************************/
+static uint8_t SetStartCluster(File_t *file, uint16_t cluster)
+{
+	DirEntry_t *dir;
+
+	file->SectorInCache = file->DirectorySector;
+	if(SD_SUCCESS != SDC_GetSector(file->SectorInCache, file->Cache))	// read the directory entry for this file.
+	{
+		Fat16_Deinit();
+		return(0);
+	}
+	dir = (DirEntry_t *)file->Cache;
+	dir[file->DirectoryIndex].StartCluster = cluster;
+	dir[file->DirectoryIndex].Size = 0;
+	if(SD_SUCCESS != SDC_PutSector(file->SectorInCache, file->Cache))	// write back to sd-card
+	{
+		Fat16_Deinit();
+		return(0);
+	}
+	return(1);
+}
+
+
 /********************************************************************************************************************************************/
 /*	Function: 		File_t * fopen_(int8_t* filename, int8_t mode);																			 	  	*/
 /*																																	  		*/
@@ -1270,6 +1457,7 @@ uint8_t FileCreate(const int8_t* filename, const uint8_t attrib, File_t *file)
 File_t * fopen_(int8_t * const filename, const int8_t mode)
 {
 	File_t *file	= 0;
+	uint16_t cluster;
 
 	if((!Partition.IsValid) || (filename == 0)) return(file);
 
@@ -1286,6 +1474,7 @@ File_t * fopen_(int8_t * const filename, const int8_t mode)
 	file->ByteOfCurrSector 			= 0;		// The bytelocation within the current sector (cluster_pointer + sector_index + byte_index).
 	file->Mode 						= mode;		// mode of fileoperation (read,write)
 	file->Size	 					= 0;		// the size of the opened file in bytes.
+	file->DateTime	 				= 0;		// the date time of the last write access to the file.
 	file->Position	 				= 0;		// pointer to a byte within the file 0 < fileposition < filesize
 	file->SectorInCache		 		= 0;		// the last sector read, wich is still in the sectorbuffer.
 	file->DirectorySector	 		= 0;		// the sectorposition where the directoryentry has been made.
@@ -1316,10 +1505,18 @@ File_t * fopen_(int8_t * const filename, const int8_t mode)
 				}
 				else
 				{	// file is not marked as read only --> goto start of file
-					// free all clusters of that file
+					// mark an empty cluster as the last one and enter it as the first cluster into the directory entry,
+					// the old clusters are freed afterwards, so a power loss in between leaves lost clusters but no cross link
+					cluster = FindNextFreeCluster(file);
+					if(!cluster || !SetStartCluster(file, cluster))
+					{
+						fclose_(file);
+						file = NULL;
+						break;
+					}
+					// free all clusters of the old content
 					DeleteClusterChain(SectorToFat16Cluster(file->FirstSectorOfFirstCluster));
-					// mar an empy cluster as the last one and store the corresponding sector
-					file->FirstSectorOfFirstCluster = Fat16ClusterToSector(FindNextFreeCluster(file));
+					file->FirstSectorOfFirstCluster = Fat16ClusterToSector(cluster);
 					file->FirstSectorOfCurrCluster = file->FirstSectorOfFirstCluster;
 					file->SectorOfCurrCluster = 0;
 					file->ByteOfCurrSector = 0;
@@ -1377,7 +1574,7 @@ int16_t	fflush_(File_t * const file)
 {
 	DirEntry_t *dir;
 
-	if((file == NULL) || (!Partition.IsValid)) return (EOF);
+	if((file == NULL) || (file->State != FSTATE_USED) || (!Partition.IsValid)) return (EOF);
 
 	switch(file->Mode)
 	{
@@ -1401,6 +1598,7 @@ int16_t	fflush_(File_t * const file)
 			dir = (DirEntry_t *)file->Cache;
 			dir[file->DirectoryIndex].Size = file->Size;						// update file size
 			dir[file->DirectoryIndex].DateTime = FileDateTime(&SystemTime);		// update date time
+			file->DateTime = dir[file->DirectoryIndex].DateTime;
 			if(SD_SUCCESS != SDC_PutSector(file->SectorInCache, file->Cache))	// write back to sd-card
 			{
 				Fat16_Deinit();
@@ -1429,7 +1627,7 @@ int16_t fclose_(File_t *file)
 	int16_t returnvalue = EOF;
 
 	if(file == NULL) return(returnvalue);
-	returnvalue = fflush_(file);
+	if(file->State == FSTATE_USED) returnvalue = fflush_(file); // the data of an invalid file is lost
 	UnlockFilePointer(file);
 	return(returnvalue);
 }
@@ -1447,9 +1645,9 @@ int16_t fgetc_(File_t * const file)
 	int16_t c = EOF;
 	uint32_t curr_sector;
 
-	if( (!Partition.IsValid) || (file == NULL)) return(c);
+	if( (!Partition.IsValid) || (file == NULL) || (file->State != FSTATE_USED)) return(c);
 	// if the end of the file is not reached, get the next character.
-	if((0 < file->Size) && ((file->Position+1) < file->Size) )
+	if(file->Position < file->Size)
 	{
 		curr_sector  = file->FirstSectorOfCurrCluster;		// calculate the sector of the next character to be read.
 		curr_sector += file->SectorOfCurrCluster;
@@ -1500,7 +1698,7 @@ int16_t fputc_(const int8_t c, File_t * const file)
 {
 	uint32_t curr_sector  = 0;
 
-	if((!Partition.IsValid) || (file == NULL)) return(EOF);
+	if((!Partition.IsValid) || (file == NULL) || (file->State != FSTATE_USED)) return(EOF);
 
 	// If file position equals to file size, then the end of file has reached.
 	// In this chase it has to be checked that the ByteOfCurrSector is BYTES_PER_SECTOR
@@ -1579,14 +1777,14 @@ uint32_t fread_(void * const buffer, uint32_t size, uint32_t count, File_t * con
 	while((object_cnt < count) && success)
 	{
 		object_size = size;
-		while((size > 0) && success)
+		while((object_size > 0) && success)
 		{
 			c = fgetc_(file);
 			if(c != EOF)
 			{
 				*pbuff = (uint8_t)c; 									// read a byte from the buffer to the opened file.
 				pbuff++;
-				size--;
+				object_size--;
 			}
 			else // error or end of file reached
 			{
@@ -1603,7 +1801,8 @@ uint32_t fread_(void * const buffer, uint32_t size, uint32_t count, File_t * con
 /*	Function: 		fwrite_(void *buffer, uint32_t size, uint32_t count, File *file);																*/
 /*																																	  	*/
 /*	Description:	This function writes count objects of the specified size 															*/
-/*					from the buffer pointer to the actual position in the file.															*/
+/*					from the buffer pointer to the actual position in the file. The bytes up to the last one of the cached sector		*/
+/*					are copied at once, the last byte is written by fputc_() that saves the sector and appends a new cluster.			*/
 /*																																	   	*/
 /*	Returnvalue:	The function returns the number of objects (not bytes) read from the file.											*/
 /****************************************************************************************************************************************/
@@ -1613,6 +1812,7 @@ uint32_t fwrite_(void * const buffer, uint32_t size, uint32_t count, File_t * co
 	uint32_t object_size = 0;														// count the number of bytes written from the actual object.
 	uint8_t *pbuff	    = 0;														// a pointer to the actual bufferposition.
 	uint8_t success      = 1;														// no error occured during write operation to the file.
+	uint16_t n;
 	int16_t c;
 
 	if((!Partition.IsValid) || (file == NULL) || (buffer == NULL)) return(0);
@@ -1622,13 +1822,26 @@ uint32_t fwrite_(void * const buffer, uint32_t size, uint32_t count, File_t * co
 	while((object_cnt < count) && success)
 	{
 		object_size = size;
-		while((size > 0) && success)
+		while((object_size > 0) && success)
 		{
+			if((file->State == FSTATE_USED) && (file->ByteOfCurrSector < BYTES_PER_SECTOR - 1) &&
+			   (file->SectorInCache == file->FirstSectorOfCurrCluster + file->SectorOfCurrCluster))
+			{	// copy the bytes that fit into the cached sector in front of its last byte
+				n = BYTES_PER_SECTOR - 1 - file->ByteOfCurrSector;
+				if(n > object_size) n = (uint16_t)object_size;
+				memcpy(&file->Cache[file->ByteOfCurrSector], pbuff, n);
+				file->ByteOfCurrSector += n;
+				file->Position += n;
+				if(file->Position > file->Size) file->Size = file->Position;
+				pbuff += n;
+				object_size -= n;
+				if(!object_size) break;
+			}
 			c = fputc_(*pbuff, file);										// write a byte from the buffer to the opened file.
 			if(c != EOF)
 			{
 				pbuff++;
-				size--;
+				object_size--;
 			}
 			else
 			{
@@ -1730,6 +1943,7 @@ uint8_t fexist_(int8_t* const filename)
 /****************************************************************************************************************************************/
 uint8_t feof_(File_t *file)
 {
+	if((file == NULL) || (file->State != FSTATE_USED)) return(1);
 	if(((file->Position)+1) < (file->Size))
 	{
 		return(0);
@@ -1740,4 +1954,18 @@ uint8_t feof_(File_t *file)
 	}
 }
 
+/****************************************************************************************************************************************/
+/*	Function: 		ferror_(File_t *File);																								*/
+/*																																	  	*/
+/*	Description:	This function checks wether the file can still be accessed. This is not the case if the card has been removed		*/
+/*					or the filesystem has been released after an error while the file was open.										*/
+/*																																	   	*/
+/*	Returnvalue:	0 if the file is valid otherwise 1.																					*/
+/****************************************************************************************************************************************/
+uint8_t ferror_(File_t *file)
+{
+	if((file == NULL) || (file->State != FSTATE_USED) || (!Partition.IsValid)) return(1);
+	return(0);
+}
+
 
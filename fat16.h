@@ -29,6 +29,7 @@ typedef struct
 	uint16_t	ByteOfCurrSector;			// The byte location within the current sector.
 	uint8_t		Mode;						// Mode of fileoperation (read,write)
 	uint32_t	Size;						// The size of the opend file in bytes.
+	uint32_t	DateTime;					// The dos date time of the last write access to the opened file.
 	uint32_t	Position;					// Pointer to a character within the file 0 < fileposition < filesize
 	uint32_t	DirectorySector;			// the sectorposition where the directoryentry has been made.
 	uint16_t	DirectoryIndex;				// The index to the directoryentry within the specified sector.
@@ -47,6 +48,7 @@ typedef struct
 extern uint8_t		Fat16_Init(void);
 extern uint8_t		Fat16_Deinit(void);
 extern uint8_t		Fat16_IsValid(void);
+extern uint8_t		Fat16_Update(void);
 
 extern File_t *		fopen_(int8_t * const filename, const int8_t mode);
 extern int16_t 		fclose_(File_t *file);
@@ -60,6 +62,7 @@ extern uint32_t		fwrite_(void *buffer, uint32_t size, uint32_t count, File_t *fi
 extern int16_t		fputs_(int8_t * const string, File_t * const file);
 extern int8_t *  	fgets_(int8_t * const string, const int16_t length, File_t * const file);
 extern uint8_t 		feof_(File_t * const file);
+extern uint8_t 		ferror_(File_t * const file);
 
 
 
@@ -1,49 +1,80 @@
 #include "fifo.h"
-#include <avr/io.h>
+
 unsigned char fifo_init (fifo_t* f, unsigned char* buffer, const unsigned int size)
 {
-	//if(f == NULL) return(0);
 	f->buffer = buffer;
-	f->size = size;
+	f->mask = 0;
+	f->overflow = 0;
+	f->highwater = 0;
 	fifo_purge(f);
+	if((size < 2) || (size > 32768U) || (size & (size - 1))) return(0); // not a power of two
+	f->mask = (uint16_t)(size - 1);
 	return(1);
 }
 
-unsigned char fifo_put (fifo_t* f, const unsigned char data)
+unsigned char fifo_get_wait (fifo_t* f, unsigned char* pdata)
 {
-	if(f->buffer == 0) return(0);
-	if (f->pwrite==f->pread-1 ||f->pwrite==f->pread-1 +f->size ) return(0);	// return 0 in case of FIFO overflow.
+	while (!fifo_get(f, pdata));
 
-	*(f->pwrite++) = data;	    // copy data byte to buffer
-	if(f->pwrite >= f->buffer + f->size) f->pwrite = f->buffer; // start at the begining after reaching the end 
-//UDR0=*(f->pwrite-1);
-	//f->count++;
 	return(1);
 }
 
-unsigned char fifo_get (fifo_t* f, unsigned char* pdata)
+unsigned int fifo_put_bulk (fifo_t* f, const unsigned char* pdata, unsigned int count)
 {
-	if(f->buffer == 0) return(0);
-	if(f->pread==f->pwrite) return(0);
-	*pdata = *(f->pread++);
-	if(f->pread >= f->buffer + f->size) f->pread = f->buffer; // start at the begining after reaching the end 
+	uint16_t head = f->head;
+	uint16_t tail = fifo_load(&f->tail);
+	uint16_t space = (tail - head - 1) & f->mask;
+	unsigned int n;
 
-	//f->count--;
-	return(1);
+	if(count > space)
+	{
+		f->overflow += count - space;
+		count = space;
+	}
+	for(n = count; n; n--)
+	{
+		f->buffer[head] = *pdata++;
+		head = (head + 1) & f->mask;
+	}
+	fifo_store(&f->head, head);	// store the bytes before they are published
+	if(((head - tail) & f->mask) > f->highwater) f->highwater = (head - tail) & f->mask;
+	return(count);
 }
 
-unsigned char fifo_get_wait (fifo_t* f, unsigned char* pdata)
+unsigned int fifo_get_bulk (fifo_t* f, unsigned char* pdata, unsigned int count)
 {
-	while (!f->count);
+	uint16_t tail = f->tail;
+	uint16_t used = (fifo_load(&f->head) - tail) & f->mask;
+	unsigned int n;
+
+	if(count > used) count = used;
+	for(n = count; n; n--)
+	{
+		*pdata++ = f->buffer[tail];
+		tail = (tail + 1) & f->mask;
+	}
+	fifo_store(&f->tail, tail);	// read the bytes before the slots are released
+	return(count);
+}
 
-	return fifo_get(f, pdata);
+unsigned int fifo_get_span (fifo_t* f, unsigned char** pdata)
+{
+	uint16_t tail = f->tail;
+	uint16_t head = fifo_load(&f->head); // the write index is moved by the producer
+
+	*pdata = &f->buffer[tail];
+	if(head >= tail) return(head - tail);
+	else return((unsigned int)f->mask + 1 - tail); // up to the end of the buffer
+}
+
+void fifo_release (fifo_t* f, const unsigned int count)
+{
+	fifo_store(&f->tail, (f->tail + count) & f->mask);	// the span has to be read before it is released
 }
 
 void fifo_purge(fifo_t* f)
 {
-	//if((f == NULL)) return;
-	f->count = 0;
-	f->pread = f->buffer;
-	f->pwrite = f->buffer; 
-	return;	
+	fifo_store(&f->head, 0);
+	fifo_store(&f->tail, 0);
+	return;
 }
@@ -1,33 +1,116 @@
 #ifndef _FIFO_H_
 #define _FIFO_H_
 
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/*
+The FIFO is a ring buffer for one producer and one consumer, e.g. an ISR and the main loop.
+The write index is only changed by the producer and the read index only by the consumer.
+The indices are 16 bit wide and the AVR accesses them in two steps. The index of the other side
+is read twice until both reads match, the interrupts stay enabled. An ISR cannot be interrupted
+by the main loop, so it gets a consistent value at the first try. The own index is written with
+disabled interrupts for 2 instructions, otherwise an ISR could read a half written index.
+The buffer size must be a power of two and at most 32768 bytes.
+One byte of the buffer is always kept free to distinguish a full from an empty FIFO.
+*/
+
+// the compiler must not move buffer accesses across the update of an index
+#define FIFO_BARRIER() __asm__ __volatile__ ("" ::: "memory")
 
 // the fifo object
 typedef struct
 {
 	unsigned char *buffer;				// pointer to start of the ringbuffer
-	unsigned int count;				// number of bytes in FIFO
- 	unsigned int size;				// buffer size
-	unsigned char *pread;				// read pointer
-	unsigned char *pwrite;				// write pointer
+	uint16_t mask;						// buffer size - 1
+	volatile uint16_t head;				// write index, changed by the producer only
+	volatile uint16_t tail;				// read index, changed by the consumer only
+	uint16_t highwater;					// max. number of bytes in the FIFO
+	volatile uint16_t overflow;			// number of bytes lost because the FIFO was full
 } fifo_t;
 
+// reads an index that may be changed by an ISR, an update between the two bytes is detected by a second read
+static inline uint16_t fifo_load (volatile uint16_t* pindex)
+{
+	uint16_t index;
+
+	do
+	{
+		index = *pindex;
+	} while(index != *pindex);
+	return(index);
+}
+
+// writes an index that may be read by an ISR
+static inline void fifo_store (volatile uint16_t* pindex, const uint16_t index)
+{
+	uint8_t sreg = SREG;
+
+	FIFO_BARRIER();	// access the buffer before the index is published
+	cli();
+	*pindex = index;
+	SREG = sreg;
+}
+
 /*
-The initialization of the FIFO sets the read/write pointers etc..
+The initialization of the FIFO sets the read/write indices etc..
 The FIFO uses the buffer 'buf' which byte length must 'size'.
-Returns 1 on success ans 0 in case of an error.
+Returns 1 on success ans 0 in case of an error. The size must be a power of two up to 32768,
+otherwise the FIFO remains empty and every put fails.
 */
 unsigned char fifo_init (fifo_t* f, unsigned char* buffer, const unsigned int size);
 
 /*
 Puts a byte into the FIFO. Returns 1 on success and 0 in case of FIFO overflow.
+It is inlined to keep the receive ISRs short.
 */
-unsigned char fifo_put (fifo_t* f, const unsigned char data);
+static inline unsigned char fifo_put (fifo_t* f, const unsigned char data)
+{
+	uint16_t head = f->head;
+	uint16_t tail = fifo_load(&f->tail);
+	uint16_t next = (head + 1) & f->mask;
+
+	if(next == tail)
+	{
+		f->overflow++;
+		return(0);
+	}
+	f->buffer[head] = data;
+	fifo_store(&f->head, next);	// store the byte before it is published
+	next = (next - tail) & f->mask; // number of bytes in the FIFO
+	if(next > f->highwater) f->highwater = next;
+	return(1);
+}
 
 /*
 Get the next byte from the FIFO. Returns 0 if the FIFO is empty.
 */
-unsigned char fifo_get (fifo_t* f, unsigned char* pdata);
+static inline unsigned char fifo_get (fifo_t* f, unsigned char* pdata)
+{
+	uint16_t tail = f->tail;
+
+	if(tail == fifo_load(&f->head)) return(0);
+	*pdata = f->buffer[tail];
+	fifo_store(&f->tail, (tail + 1) & f->mask);	// read the byte before the slot is released
+	return(1);
+}
+
+/*
+Returns the number of bytes that can be put into the FIFO, has to be called by the producer.
+*/
+static inline uint16_t fifo_space (fifo_t* f)
+{
+	return((fifo_load(&f->tail) - f->head - 1) & f->mask);
+}
+
+/*
+Returns the number of bytes in the FIFO, has to be called by the consumer.
+*/
+static inline uint16_t fifo_used (fifo_t* f)
+{
+	return((fifo_load(&f->head) - f->tail) & f->mask);
+}
 
 /*
 Get the next byte out of the FIFO. If the FIFO is empty the function blocks
@@ -36,7 +119,30 @@ until the next byte is put into the FIFO.
 unsigned char fifo_get_wait (fifo_t* f, unsigned char* pdata);
 
 /*
-Purges the FIFO so that it is empty afterwards
+Puts up to 'count' bytes into the FIFO and publishes them at once.
+Returns the number of bytes stored, the remaining bytes are counted as overflow.
+*/
+unsigned int fifo_put_bulk (fifo_t* f, const unsigned char* pdata, unsigned int count);
+
+/*
+Gets up to 'count' bytes out of the FIFO. Returns the number of bytes read.
+*/
+unsigned int fifo_get_bulk (fifo_t* f, unsigned char* pdata, unsigned int count);
+
+/*
+Returns the number of bytes that can be read in one piece from the FIFO
+and sets *pdata to the first of them. The bytes stay in the FIFO until
+they are released by fifo_release().
+*/
+unsigned int fifo_get_span (fifo_t* f, unsigned char** pdata);
+
+/*
+Removes the first 'count' bytes of the last span from the FIFO.
+*/
+void fifo_release (fifo_t* f, const unsigned int count);
+
+/*
+Purges the FIFO so that it is empty afterwards. Must not be called while the producer is active.
 */
 void fifo_purge (fifo_t* f);
 
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include "gps.h"
 #include "uart0.h"
 #include "main.h"
@@ -6,6 +7,21 @@
 #define GPS_TIMEOUT 1000  // if no new gps data arrive within that time an error is set
 #define GPS_MINSATS 4
 
+#define GPS_SCALE_LAT			230		// 1e-7 deg per cm of latitude in 1/256
+#define GPS_TRACKER_ALPHA		77		// position gain in 1/256
+#define GPS_TRACKER_BETA		128		// speed gain in 1/256
+#define GPS_TRACKER_TIMEOUT		3000	// in ms, restart the tracker if the fixes are older
+#define GPS_TRACKER_MAXINNOV	50000	// in 1e-7 deg, restart the tracker on a position jump of about 50 m
+#define GPS_TRACKER_MAXLAT		850		// in 0.1 deg, limit of the longitude scaling
+
+#define GPS_FM_INTERVAL			1000	// in ms, follow me interval at walking speed
+#define GPS_FM_KEEPALIVE		4000	// in ms, follow me interval if the target stands still
+#define GPS_FM_DISTANCE			500		// in cm, send at once if the target moved that far
+#define GPS_FM_HEADING			3000000L // in 1e-5 deg, send at once if the target turns by 30 deg
+#define GPS_FM_SPEED_STILL		50		// in cm/s, below the target stands still, above the heading is valid
+#define GPS_FM_SPEED_MOVING		200		// in cm/s, above the target is faster than walking
+#define GPS_FM_SPEED_FAST		350		// in cm/s, above the target is running
+
 //------------------------------------------------------------
 // copy GPS position from source position to target position
 uint8_t GPS_CopyPosition(GPS_Pos_t * pGPSPosSrc, GPS_Pos_t* pGPSPosTgt)
@@ -43,11 +59,199 @@ uint8_t GPS_ClearPosition(GPS_Pos_t * pGPSPos)
 }
 
 
+//------------------------------------------------------------
+// alpha-beta tracker of the follow me position
+// cos(latitude) in steps of 10 deg scaled by 32768
+const uint16_t GPS_CosTab[10] = {32768, 32270, 30792, 28378, 25102, 21063, 16384, 11207, 5690, 0};
+
+GPS_Tracker_t GPS_Tracker = {{0,0,0},{0,0,0}, GPS_SCALE_LAT, 0, GPS_TRACKER_ALPHA, GPS_TRACKER_BETA, INVALID};
+
+// distance in 1e-7 deg travelled with speed in cm/s within dt in ms
+int32_t GPS_Distance(int32_t speed, uint16_t dt, uint16_t scale)
+{
+	int32_t dist;
+	dist = (speed * (int32_t)dt) / 100; // in mm
+	return((dist * (int32_t)scale) / 2560);
+}
+
+// 1e-7 deg per cm of longitude at the given latitude in 1/256
+uint16_t GPS_ScaleLon(int32_t latitude)
+{
+	uint16_t deg, cos;
+	uint8_t i;
+
+	if(latitude < 0) latitude = -latitude;
+	deg = (uint16_t)(latitude / 1000000L); // in 0.1 deg
+	if(deg > GPS_TRACKER_MAXLAT) deg = GPS_TRACKER_MAXLAT;
+	i = deg / 100;
+	cos = GPS_CosTab[i] - (uint16_t)(((uint32_t)(GPS_CosTab[i] - GPS_CosTab[i+1]) * (deg % 100)) / 100);
+	return((uint16_t)(((uint32_t)GPS_SCALE_LAT << 15) / cos));
+}
+
+// update one axis of the tracker with the measured position and speed,
+// returns 0 if the position jumped too far from the prediction
+uint8_t GPS_TrackAxis(GPS_Axis_t * pAxis, int32_t position, int32_t speed, uint16_t dt, uint16_t scale)
+{
+	int32_t predicted;
+	predicted = pAxis->Position + GPS_Distance(pAxis->Speed, dt, scale);
+	pAxis->Innovation = position - predicted;
+	if(labs(pAxis->Innovation) > GPS_TRACKER_MAXINNOV) return(0);
+	pAxis->Position = predicted + (pAxis->Innovation * GPS_Tracker.Alpha) / 256;
+	pAxis->Speed += ((speed - pAxis->Speed) * GPS_Tracker.Beta) / 256;
+	return(1);
+}
+
+// feed the tracker with a new gps fix
+void GPS_TrackerUpdate(gps_data_t * pGPSData)
+{
+	uint16_t dt;
+	dt = CountMilliseconds - GPS_Tracker.Time;
+	GPS_Tracker.Time = CountMilliseconds;
+	GPS_Tracker.ScaleLon = GPS_ScaleLon(pGPSData->Position.Latitude);
+	if((GPS_Tracker.Status != INVALID) && (dt < GPS_TRACKER_TIMEOUT))
+	{
+		// a jump of the position restarts the tracker
+		if(GPS_TrackAxis(&(GPS_Tracker.Lat), pGPSData->Position.Latitude, pGPSData->Speed_North, dt, GPS_SCALE_LAT) &&
+		   GPS_TrackAxis(&(GPS_Tracker.Lon), pGPSData->Position.Longitude, pGPSData->Speed_East, dt, GPS_Tracker.ScaleLon)) return;
+	}
+	// start with the measured values
+	GPS_Tracker.Lat.Position = pGPSData->Position.Latitude;
+	GPS_Tracker.Lat.Speed = pGPSData->Speed_North;
+	GPS_Tracker.Lat.Innovation = 0;
+	GPS_Tracker.Lon.Position = pGPSData->Position.Longitude;
+	GPS_Tracker.Lon.Speed = pGPSData->Speed_East;
+	GPS_Tracker.Lon.Innovation = 0;
+	GPS_Tracker.Status = NEWDATA;
+}
+
+// extrapolate the tracked position by latency ms from now
+uint8_t GPS_PredictPosition(GPS_Pos_t * pGPSPos, uint16_t latency)
+{
+	uint16_t dt;
+	if((pGPSPos == 0) || (GPS_Tracker.Status == INVALID)) return(0);
+	dt = CountMilliseconds - GPS_Tracker.Time + latency;
+	if(dt > GPS_TRACKER_TIMEOUT) return(0); // do not extrapolate too far
+	pGPSPos->Latitude	= GPS_Tracker.Lat.Position + GPS_Distance(GPS_Tracker.Lat.Speed, dt, GPS_SCALE_LAT);
+	pGPSPos->Longitude	= GPS_Tracker.Lon.Position + GPS_Distance(GPS_Tracker.Lon.Speed, dt, GPS_Tracker.ScaleLon);
+	return(1);
+}
+
+//------------------------------------------------------------
+// follow me scheduler, the interval of the messages follows the motion of the target
+GPS_Pos_t GPS_FollowMeLast = {0,0,0,INVALID};	// position of the last follow me message
+int32_t GPS_FollowMeHeading = 0;				// heading at the last follow me message
+uint16_t GPS_FollowMeInterval = GPS_FM_INTERVAL;	// current interval in ms
+
+// approximated distance in cm between the tracked position and the position of the last message
+uint32_t GPS_FollowMeDistance(void)
+{
+	int32_t north, east;
+
+	north = GPS_Tracker.Lat.Position - GPS_FollowMeLast.Latitude;
+	east = GPS_Tracker.Lon.Position - GPS_FollowMeLast.Longitude;
+	// limit to avoid an overflow, the distance is far beyond any threshold then
+	if(labs(north) > 1000000L) north = 1000000L;
+	if(labs(east) > 1000000L) east = 1000000L;
+	north = labs(north * 256 / GPS_SCALE_LAT);
+	east = labs(east * 256 / GPS_Tracker.ScaleLon);
+	if(north > east) return(north + east / 2);
+	else return(east + north / 2);
+}
+
+// returns 1 if the next follow me message should be sent, elapsed is the time since the last one in ms
+uint8_t GPS_FollowMeDue(uint16_t elapsed, uint16_t tolerance)
+{
+	uint32_t distance;
+	int32_t heading;
+
+	if((GPS_Tracker.Status == INVALID) || (GPS_FollowMeLast.Status == INVALID))
+	{
+		GPS_FollowMeInterval = GPS_FM_INTERVAL;
+	}
+	else
+	{
+		distance = GPS_FollowMeDistance();
+		if(distance >= GPS_FM_DISTANCE) return(1); // the target moved far since the last message
+		heading = GPSData.Heading - GPS_FollowMeHeading;
+		if(heading > 18000000L) heading -= 36000000L;
+		if(heading < -18000000L) heading += 36000000L;
+		if((GPSData.Speed_Ground >= GPS_FM_SPEED_STILL) && (labs(heading) >= GPS_FM_HEADING)) return(1); // the target turns
+
+		if(GPSData.Speed_Ground >= GPS_FM_SPEED_FAST) GPS_FollowMeInterval = GPS_FM_INTERVAL / 4;
+		else if(GPSData.Speed_Ground >= GPS_FM_SPEED_MOVING) GPS_FollowMeInterval = GPS_FM_INTERVAL / 2;
+		else if((GPSData.Speed_Ground < GPS_FM_SPEED_STILL) && (distance <= tolerance)) GPS_FollowMeInterval = GPS_FM_KEEPALIVE; // the target stands still
+		else GPS_FollowMeInterval = GPS_FM_INTERVAL;
+	}
+	return(elapsed >= GPS_FollowMeInterval);
+}
+
+// remember the position and heading of the sent follow me message
+void GPS_FollowMeSent(GPS_Pos_t * pGPSPos)
+{
+	GPS_FollowMeLast.Latitude = pGPSPos->Latitude;
+	GPS_FollowMeLast.Longitude = pGPSPos->Longitude;
+	GPS_FollowMeLast.Status = GPS_Tracker.Status;
+	GPS_FollowMeHeading = GPSData.Heading;
+}
+
+//------------------------------------------------------------
+// latency of the follow me frames from the gps receiver to the radio
+GPS_Stamp_t GPS_FollowMeStamp;						// time stamps of the frame in transmission
+volatile uint8_t GPS_FollowMeTxState = FM_TX_IDLE;
+GPS_Latency_t GPS_Latency;
+uint16_t GPS_LatencySample[GPS_LATENCY_SAMPLES];	// total latencies of the last frames
+uint8_t GPS_LatencyIndex = 0;
+// upper limits of the histogram bins in ms
+const uint16_t GPS_LatencyBin[GPS_LATENCY_BINS - 1] = {10, 20, 50, 100, 200, 500, 1000};
+
+// evaluate the time stamps of a sent follow me frame
+void GPS_LatencyUpdate(void)
+{
+	uint16_t latency;
+	uint32_t sum = 0;
+	uint8_t i, bin;
+
+	if(GPS_FollowMeTxState != FM_TX_DONE) return;
+	GPS_Latency.RxToCheck		= GPS_FollowMeStamp.CheckTime - GPS_FollowMeStamp.RxTime;
+	GPS_Latency.CheckToPublish	= GPS_FollowMeStamp.PublishTime - GPS_FollowMeStamp.CheckTime;
+	GPS_Latency.PublishToTx		= GPS_FollowMeStamp.TxStartTime - GPS_FollowMeStamp.PublishTime;
+	GPS_Latency.TxDuration		= GPS_FollowMeStamp.TxDoneTime - GPS_FollowMeStamp.TxStartTime;
+	GPS_Latency.Total			= GPS_FollowMeStamp.TxDoneTime - GPS_FollowMeStamp.RxTime;
+	GPS_FollowMeTxState = FM_TX_IDLE; // ready for the next frame
+
+	GPS_LatencySample[GPS_LatencyIndex] = GPS_Latency.Total;
+	if(++GPS_LatencyIndex >= GPS_LATENCY_SAMPLES) GPS_LatencyIndex = 0;
+	if(GPS_Latency.Count < GPS_LATENCY_SAMPLES) GPS_Latency.Count++;
+
+	// distribution of the last samples
+	GPS_Latency.Min = 0xFFFF;
+	GPS_Latency.Max = 0;
+	for(bin = 0; bin < GPS_LATENCY_BINS; bin++) GPS_Latency.Histogram[bin] = 0;
+	for(i = 0; i < GPS_Latency.Count; i++)
+	{
+		latency = GPS_LatencySample[i];
+		sum += latency;
+		if(latency < GPS_Latency.Min) GPS_Latency.Min = latency;
+		if(latency > GPS_Latency.Max) GPS_Latency.Max = latency;
+		for(bin = 0; (bin < GPS_LATENCY_BINS - 1) && (latency >= GPS_LatencyBin[bin]); bin++);
+		GPS_Latency.Histogram[bin]++;
+	}
+	GPS_Latency.Mean = (uint16_t)(sum / GPS_Latency.Count);
+}
+
+Timer_t GPS_TimeoutTimer;
+
+//------------------------------------------------------------
+// called by the timer wheel if no new gps data arrived within GPS_TIMEOUT
+static void GPS_Timeout(void)
+{
+	if(GPSData.Status == PROCESSED) GPSData.Status = INVALID;
+}
+
 //------------------------------------------------------------
 // check for new GPS data
 void GPS_Update(void)
 {
-	static uint16_t GPS_Timeout = 0;
 	static uint16_t beep_rythm = 0;
 
 	switch(GPSData.Status)
@@ -55,29 +259,28 @@ void GPS_Update(void)
 		case INVALID:
 			Error |= ERROR_GPS_RX_TIMEOUT;
 			GPS_ClearPosition(&(FollowMe.Position)); // clear followme position
+			GPS_Tracker.Status = INVALID;
 			break;
 
 		case PROCESSED:
-			// wait for timeout
-			if(CheckDelay(GPS_Timeout))
-			{
-				GPSData.Status = INVALID;
-			}
+			// wait for new data or the timeout
 			break;
 
 		case NEWDATA:
-			GPS_Timeout = SetDelay(GPS_TIMEOUT); // reset gps timeout
+			Timer_Start(&GPS_TimeoutTimer, GPS_TIMEOUT, 0, GPS_Timeout); // reset gps timeout
 			Error &= ~ERROR_GPS_RX_TIMEOUT; 	// clear possible error
 			beep_rythm++;
 
 			// update data in the follow me message
 			if((GPSData.SatFix & SATFIX_3D) && (GPSData.NumOfSats >= GPS_MINSATS))
 			{
+					GPS_TrackerUpdate(&GPSData);
 					GPS_CopyPosition(&(GPSData.Position),&(FollowMe.Position));
 			}
 			else
 			{
 				GPS_ClearPosition(&(FollowMe.Position)); // clear followme position
+				GPS_Tracker.Status = INVALID;
 		  	}
 
 			// NC like sound on bad gps signals
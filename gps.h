@@ -2,6 +2,63 @@
 #define _GPS_H
 
 #include "ubx.h"
+
+typedef struct
+{
+	int32_t Position;	// filtered position in 1e-7 deg
+	int32_t Speed;		// filtered speed in cm/s
+	int32_t Innovation;	// measured - predicted position of the last fix in 1e-7 deg
+} GPS_Axis_t;
+
+// alpha-beta tracker of the follow me position
+typedef struct
+{
+	GPS_Axis_t	Lat;
+	GPS_Axis_t	Lon;
+	uint16_t	ScaleLon;	// 1e-7 deg per cm of longitude in 1/256
+	uint16_t	Time;		// time of the last fix in ms
+	uint8_t		Alpha;		// position gain in 1/256
+	uint8_t		Beta;		// speed gain in 1/256
+	uint8_t		Status;		// INVALID until the first fix
+} GPS_Tracker_t;
+
+extern GPS_Tracker_t GPS_Tracker;
+
+#define GPS_LATENCY_SAMPLES	16
+#define GPS_LATENCY_BINS	8
+
+// latency of the follow me frames in ms
+typedef struct
+{
+	uint16_t	RxToCheck;		// stages of the last frame
+	uint16_t	CheckToPublish;
+	uint16_t	PublishToTx;
+	uint16_t	TxDuration;
+	uint16_t	Total;			// from the first gps byte until the frame is sent
+	uint16_t	Min;			// distribution of the total latency of the last frames
+	uint16_t	Mean;
+	uint16_t	Max;
+	uint8_t		Count;			// number of frames in the distribution
+	uint8_t		Histogram[GPS_LATENCY_BINS];	// <10, <20, <50, <100, <200, <500, <1000, >=1000 ms
+} __attribute__((packed)) GPS_Latency_t;
+
+// transmission state of the follow me frame
+#define FM_TX_IDLE		0
+#define FM_TX_SENDING	1
+#define FM_TX_DONE		2
+
+extern GPS_Latency_t GPS_Latency;
+extern GPS_Stamp_t GPS_FollowMeStamp;
+extern volatile uint8_t GPS_FollowMeTxState;
+
 extern void GPS_Update(void);
+extern void GPS_LatencyUpdate(void);
+// sets the latitude and longitude to the tracked position extrapolated by latency ms from now
+extern uint8_t GPS_PredictPosition(GPS_Pos_t * pGPSPos, uint16_t latency);
+// returns 1 if the next follow me message is due, elapsed is the time since the last message
+// and tolerance the radius in cm the target may move without being tracked
+extern uint8_t GPS_FollowMeDue(uint16_t elapsed, uint16_t tolerance);
+extern void GPS_FollowMeSent(GPS_Pos_t * pGPSPos);
+extern uint16_t GPS_FollowMeInterval;
 
 #endif //_GPS_H
@@ -376,7 +376,7 @@ uint8_t GPX_TrackSegementAddPoint(GPX_Document_t *doc)
 				fputs_(string, doc->file);
 				sprintf(string, "</trkpt>\r\n");
 				fputs_(string, doc->file);
-				retvalue = 1;
+				if(!ferror_(doc->file)) retvalue = 1; // the card may have been removed
 			}
 		}
 	}
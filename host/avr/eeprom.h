@@ -0,0 +1,18 @@
+#ifndef _HOST_AVR_EEPROM_H
+#define _HOST_AVR_EEPROM_H
+
+// Minimal replacement of <avr/eeprom.h> for the host build.
+// EEMEM variables are collected in the section host_eeprom, that is loaded from
+// and saved to the file given by the environment variable HOST_EEPROM (see host.c).
+
+#include <inttypes.h>
+#include <string.h>
+
+#define EEMEM	__attribute__((section("host_eeprom")))
+
+#define eeprom_read_block(dst, src, n)		memcpy((dst), (src), (n))
+#define eeprom_write_block(src, dst, n)		memcpy((dst), (src), (n))
+#define eeprom_read_byte(addr)				(*(const uint8_t *)(addr))
+#define eeprom_write_byte(addr, value)		(*(uint8_t *)(addr) = (value))
+
+#endif //_HOST_AVR_EEPROM_H
@@ -0,0 +1,13 @@
+#ifndef _HOST_AVR_INTERRUPT_H
+#define _HOST_AVR_INTERRUPT_H
+
+// Minimal replacement of <avr/interrupt.h> for the host build.
+// An ISR becomes a normal function that is called by the host simulation.
+
+#include <avr/io.h>
+
+#define ISR(vector)	void vector(void)
+#define sei()
+#define cli()
+
+#endif //_HOST_AVR_INTERRUPT_H
@@ -0,0 +1,55 @@
+#ifndef _HOST_AVR_IO_H
+#define _HOST_AVR_IO_H
+
+// Minimal replacement of <avr/io.h> for the host build.
+// The registers are plain variables defined in host.c.
+
+#include <inttypes.h>
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t PINB, PORTB, DDRB;
+extern volatile uint8_t PINC, PORTC, DDRC;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+extern volatile uint8_t DDRA, PORTA, DIDR0, ADMUX, ADCSRA, ADCSRB;
+extern volatile uint16_t ADC;
+extern volatile uint8_t PORTD, DDRD, UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+
+#define PINB2	2
+#define PINB3	3
+#define DDC7	7
+#define PORTC7	7
+#define OCF0A	1
+#define REFS1	7
+#define REFS0	6
+#define ADLAR	5
+#define ADEN	7
+#define ADSC	6
+#define ADATE	5
+#define ADIF	4
+#define ADIE	3
+#define ADPS2	2
+#define ADPS1	1
+#define ADPS0	0
+#define PORTD0	0
+#define PORTD1	1
+#define DDD0	0
+#define DDD1	1
+#define RXC0	7
+#define UDRE0	5
+#define U2X0	1
+#define RXCIE0	7
+#define TXCIE0	6
+#define RXEN0	4
+#define TXEN0	3
+#define UCSZ02	2
+#define UMSEL01	7
+#define UMSEL00	6
+#define UPM01	5
+#define UPM00	4
+#define USBS0	3
+#define UCSZ01	2
+#define UCSZ00	1
+
+#define loop_until_bit_is_set(sfr, bit)	do {} while(!((sfr) & (1 << (bit))))
+
+#endif //_HOST_AVR_IO_H
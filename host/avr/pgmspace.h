@@ -0,0 +1,19 @@
+#ifndef _HOST_AVR_PGMSPACE_H
+#define _HOST_AVR_PGMSPACE_H
+
+// Minimal replacement of <avr/pgmspace.h> for the host build.
+// There is only one address space, so flash reads are normal reads.
+
+#include <inttypes.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+#define pgm_read_byte(addr)	(*(const uint8_t *)(addr))
+#define pgm_read_word(addr)	(*(const uint16_t *)(addr))
+#define memcpy_P			memcpy
+
+typedef char prog_char;
+typedef uint8_t prog_uint8_t;
+
+#endif //_HOST_AVR_PGMSPACE_H
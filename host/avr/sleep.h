@@ -0,0 +1,16 @@
+#ifndef _HOST_AVR_SLEEP_H
+#define _HOST_AVR_SLEEP_H
+
+// Minimal replacement of <avr/sleep.h> for the host build.
+// The sleep is handed to the host simulation, that has to advance the time to the next interrupt.
+
+#define SLEEP_MODE_IDLE		0
+
+extern void Host_Sleep(void);
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()			Host_Sleep()
+
+#endif //_HOST_AVR_SLEEP_H
@@ -0,0 +1,12 @@
+#ifndef _HOST_AVR_WDT_H
+#define _HOST_AVR_WDT_H
+
+// Minimal replacement of <avr/wdt.h> for the host build, the watchdog is never started.
+
+#define WDTO_250MS		4
+
+#define wdt_enable(timeout)
+#define wdt_disable()
+#define wdt_reset()
+
+#endif //_HOST_AVR_WDT_H
@@ -0,0 +1,241 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			host.c
+// Description:			Host (Linux) simulation of the storage path. The unmodified fat16.c, settings.c, logging.c, kml.c and
+//						gpx.c are running against a disk image (see sdc_image.c) while a simulated gps track is logged.
+//						The raw data of the receiver are simulated by a NAV-PVT message at 10 Hz and a RXM-RAWX message
+//						of 16 satellites at 1 Hz, sent over the 38400 baud link of the firmware.
+//
+//						usage: fmhost <image> [seconds]
+//
+//						HOST_REMOVE_AT_MS and HOST_INSERT_AT_MS simulate the removal and the insertion of the card.
+//						HOST_EEPROM names a file that keeps the eeprom content between two runs.
+//
+//						The image has to contain a FAT16 filesystem, e.g. created by "mkfs.vfat -F 16 -C card.img 65536".
+//						The result can be checked by "fsck.vfat -n card.img" afterwards.
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "main.h"
+#include "timer0.h"
+#include "fat16.h"
+#include "settings.h"
+#include "logging.h"
+#include "ubx.h"
+#include "host.h"
+
+// registers of the host avr/io.h
+volatile uint8_t SREG;
+volatile uint8_t PINB, PORTB, DDRB;
+volatile uint8_t PINC, PORTC, DDRC;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+volatile uint8_t DDRA, PORTA, DIDR0, ADMUX, ADCSRA, ADCSRB;
+volatile uint16_t ADC;
+volatile uint8_t PORTD, DDRD, UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+
+// globals of main.c and ubx.c
+uint16_t Error = 0;
+int16_t UBat = 120;
+SysState_t SysState = STATE_UNDEFINED;
+gps_data_t GPSData = {{0,0,0,INVALID},0,0,0,0,0,0,0,0,0,0, INVALID};
+
+extern void TIMER0_COMPA_vect(void);
+
+// the EEMEM variables (see host/avr/eeprom.h)
+extern uint8_t __start_host_eeprom[], __stop_host_eeprom[];
+
+// loads (save = 0) or saves (save = 1) the eeprom content from or to the file HOST_EEPROM
+static void Host_EEPROM(uint8_t save)
+{
+	const char *filename = getenv("HOST_EEPROM");
+	size_t size = (size_t)(__stop_host_eeprom - __start_host_eeprom);
+	FILE *fp;
+
+	if(filename == NULL) return;
+	fp = fopen(filename, save ? "wb" : "rb");
+	if(fp == NULL) return;
+	if(save) fwrite(__start_host_eeprom, 1, size, fp);
+	else if(fread(__start_host_eeprom, 1, size, fp) != size) memset(__start_host_eeprom, 0xFF, size);
+	fclose(fp);
+}
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	_printf_P(char, char const *fmt0, ...);
+//
+// Description:	This function replaces the printf_P.c output to the uart by the console output.
+//________________________________________________________________________________________________________________________________________
+
+void _printf_P(char dest, char const *fmt0, ...)
+{
+	va_list ap;
+	va_start(ap, fmt0);
+	vprintf(fmt0, ap);
+	va_end(ap);
+}
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	Host_AdvanceTime(uint32_t us);
+//
+// Description:	This function advances the simulated time. The timer 0 isr is called at its rate of 1 kHz.
+//________________________________________________________________________________________________________________________________________
+
+void Host_AdvanceTime(uint32_t us)
+{
+	static uint32_t acc = 0;	// in 1/10 us
+
+	acc += us * 10;
+	while(acc >= 10000)			// 1 ms per timer 0 interrupt
+	{
+		acc -= 10000;
+		TIMER0_COMPA_vect();
+	}
+}
+
+// simulates a gps fix walking a square of 200 m
+static void Host_UpdateGPS(uint32_t ms)
+{
+	uint32_t s = ms / 1000;
+	int32_t step = (int32_t)((ms / 200) % 400) * 5; // 1e-7 deg per 200ms
+
+	GPSData.Position.Latitude	= 524000000L + ((step < 1000) ? step : (step < 2000) ? 1000 : (step < 3000) ? 3000 - step : 0);
+	GPSData.Position.Longitude	= 133000000L + ((step < 1000) ? 0 : (step < 2000) ? step - 1000 : (step < 3000) ? 1000 : 4000 - step);
+	GPSData.Position.Altitude	= 50000;
+	GPSData.Position.Status		= NEWDATA;
+	GPSData.Flags				= FLAG_GPSFIXOK|FLAG_WKNSET|FLAG_TOWSET;
+	GPSData.NumOfSats			= 8;
+	GPSData.SatFix				= SATFIX_3D;
+	GPSData.Speed_Ground		= 250;
+	GPSData.Status				= NEWDATA;
+
+	SystemTime.Year		= 2026;
+	SystemTime.Month	= 10;
+	SystemTime.Day		= 19;
+	SystemTime.Hour		= 12 + s / 3600;
+	SystemTime.Min		= (s / 60) % 60;
+	SystemTime.Sec		= s % 60;
+	SystemTime.mSec		= ms % 1000;
+	SystemTime.Valid	= 1;
+}
+
+// appends an ubx message with the payload filled by a counter
+static uint16_t Host_UBXMessage(uint8_t *pBuffer, uint8_t class, uint8_t id, uint16_t len, uint8_t seq)
+{
+	uint8_t cka = 0, ckb = 0;
+	uint16_t i;
+
+	pBuffer[0] = 0xB5;
+	pBuffer[1] = 0x62;
+	pBuffer[2] = class;
+	pBuffer[3] = id;
+	pBuffer[4] = (uint8_t)len;
+	pBuffer[5] = (uint8_t)(len >> 8);
+	for(i = 0; i < len; i++) pBuffer[6 + i] = (uint8_t)(seq + i);
+	for(i = 2; i < len + 6; i++) { cka += pBuffer[i]; ckb += cka; }
+	pBuffer[len + 6] = cka;
+	pBuffer[len + 7] = ckb;
+	return(len + 8);
+}
+
+// simulates the raw data of the receiver, the bytes are handed over in spans like by the ubx parser.
+// The link carries 3840 bytes/s at 38400 baud, the simulated messages need 1536 bytes/s.
+// Messages that do not fit into the send queue of the receiver are counted as lost.
+uint32_t Host_UBXLost = 0;
+
+static void Host_UpdateUBX(uint32_t ms)
+{
+	static uint8_t buffer[2048];	// send queue of the receiver
+	static uint16_t len = 0, pos = 0, acc = 0;
+	uint16_t span;
+
+	if(!(ms % 100)) // 10 Hz epoch: NAV-PVT, RXM-RAWX of 16 satellites once per second
+	{
+		if(pos) // move the bytes not yet sent to the front
+		{
+			memmove(buffer, &buffer[pos], len - pos);
+			len -= pos;
+			pos = 0;
+		}
+		if(len + 100 <= sizeof(buffer)) len += Host_UBXMessage(&buffer[len], 0x01, 0x07, 92, (uint8_t)(ms / 100));
+		else Host_UBXLost++;
+		if(!(ms % 1000))
+		{
+			if(len + 16 + 16 * 32 + 8 <= sizeof(buffer)) len += Host_UBXMessage(&buffer[len], 0x02, 0x15, 16 + 16 * 32, (uint8_t)(ms / 100));
+			else Host_UBXLost++;
+		}
+	}
+	acc += 384; // bytes per 100 ms at 38400 baud
+	span = acc / 100;
+	acc %= 100;
+	if(span > len - pos) span = len - pos;
+	if(span) Logging_UBXData(&buffer[pos], span);
+	pos += span;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t seconds = 60, ms, remove_at, insert_at;
+	struct timespec t0, t1;
+	double cpu_ms;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s <image> [seconds]\n", argv[0]);
+		return(1);
+	}
+	if(argc > 2) seconds = (uint32_t)strtoul(argv[2], NULL, 0);
+	if(SDC_HostOpen(argv[1]) < 0) return(1);
+	remove_at = (uint32_t)strtoul(getenv("HOST_REMOVE_AT_MS") ? getenv("HOST_REMOVE_AT_MS") : "0", NULL, 0);
+	insert_at = (uint32_t)strtoul(getenv("HOST_INSERT_AT_MS") ? getenv("HOST_INSERT_AT_MS") : "0", NULL, 0);
+
+	PINB = 0x00;	// card switch indicates a card in the slot
+	Host_EEPROM(0);
+	TIMER0_Init();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	// boot sequence of main.c, the card is mounted in the background
+	Settings_Init();
+	Logging_Init();
+
+	SysState = STATE_SEND_FOLLOWME;
+	for(ms = 0; ms < seconds * 1000; ms++)
+	{
+		if(!(ms % 200)) Host_UpdateGPS(ms);
+		Host_UpdateUBX(ms);
+		if(remove_at && (ms == remove_at)) PINB = 0xFF;	// card switch opens
+		if(insert_at && (ms == insert_at)) PINB = 0x00;
+		if(Fat16_Update())
+		{
+			printf("\r\n card mounted %u ms after boot", (unsigned)ms);
+			Settings_Init();
+			Logging_Init();
+		}
+		Logging_Update();
+		Host_AdvanceTime(1000);
+	}
+	// stop follow me to close the log files
+	SysState = STATE_IDLE;
+	for(ms = 0; ms < 2000; ms++)
+	{
+		if(Fat16_Update())
+		{
+			Settings_Init();
+			Logging_Init();
+		}
+		Logging_Update();
+		Host_AdvanceTime(1000);
+	}
+	Fat16_Deinit();
+	Host_EEPROM(1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	cpu_ms = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1000000.0;
+	printf("\r\n\r\nsectors read: %u, written: %u, failures: %u, storage time: %.1f ms, host time: %.1f ms\r\n",
+		(unsigned)SDC_HostStat.Reads, (unsigned)SDC_HostStat.Writes, (unsigned)SDC_HostStat.Failures,
+		SDC_HostStat.Time_us / 1000.0, cpu_ms);
+	printf("ubx messages lost on the link: %u\r\n", (unsigned)Host_UBXLost);
+	SDC_HostClose();
+	return(0);
+}
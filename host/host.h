@@ -0,0 +1,24 @@
+#ifndef _HOST_H
+#define _HOST_H
+
+#include <inttypes.h>
+
+// advances the simulated time by us microseconds and runs the timer isr respectively
+extern void Host_AdvanceTime(uint32_t us);
+
+// statistics of the sector backend
+typedef struct
+{
+	uint32_t Reads;			// number of sectors read
+	uint32_t Writes;		// number of sectors written
+	uint32_t Failures;		// number of injected errors
+	uint64_t Time_us;		// simulated time spent in the sector backend
+} SDC_HostStat_t;
+
+extern SDC_HostStat_t SDC_HostStat;
+
+// opens the disk image that is used as sd-card
+extern int SDC_HostOpen(const char *filename);
+extern void SDC_HostClose(void);
+
+#endif //_HOST_H
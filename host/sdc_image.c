@@ -0,0 +1,180 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			sdc_image.c
+// Description:			Host replacement of sdc.c. The sectors of the sd-card are served from a disk image that is
+//						mapped into memory. The behaviour of the card can be configured by environment variables:
+//
+//						SDC_LATENCY_US		simulated time of every sector operation (command and transfer)
+//						SDC_BUSY_US			additional simulated busy time of the card after every sector write
+//						SDC_FAIL_EVERY		every n-th sector operation fails
+//						SDC_POWERCUT_AFTER	the power is cut (process exits) instead of the n-th sector write
+//						SDC_INIT_STEPS		number of SDC_InitStep() calls until the card leaves the idle state (default 20)
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <avr/io.h>
+#include "sdc.h"
+#include "ssc.h"
+#include "host.h"
+
+SDC_HostStat_t SDC_HostStat;
+
+static uint8_t *Image = NULL;
+static size_t ImageSize = 0;
+static int ImageFd = -1;
+static uint8_t CardValid = 0;
+
+static uint32_t Latency_us = 0;
+static uint32_t Busy_us = 0;
+static uint32_t FailEvery = 0;
+static uint32_t PowerCutAfter = 0;
+static uint32_t Operations = 0;
+static uint32_t InitSteps = 20;
+static uint32_t InitStepsLeft = 0;
+
+static uint32_t GetEnv(const char *name)
+{
+	const char *value = getenv(name);
+	if(value == NULL) return(0);
+	return((uint32_t)strtoul(value, NULL, 0));
+}
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	SDC_HostOpen(const char *filename);
+//
+// Description:	This function maps the disk image into memory and reads the backend configuration.
+//
+// Returnvalue: 0 on success, -1 on error
+//________________________________________________________________________________________________________________________________________
+
+int SDC_HostOpen(const char *filename)
+{
+	struct stat st;
+
+	ImageFd = open(filename, O_RDWR);
+	if(ImageFd < 0)
+	{
+		perror(filename);
+		return(-1);
+	}
+	if(fstat(ImageFd, &st) < 0)
+	{
+		perror(filename);
+		close(ImageFd);
+		return(-1);
+	}
+	ImageSize = (size_t)st.st_size;
+	Image = mmap(NULL, ImageSize, PROT_READ|PROT_WRITE, MAP_SHARED, ImageFd, 0);
+	if(Image == MAP_FAILED)
+	{
+		perror(filename);
+		close(ImageFd);
+		Image = NULL;
+		return(-1);
+	}
+	Latency_us = GetEnv("SDC_LATENCY_US");
+	Busy_us = GetEnv("SDC_BUSY_US");
+	FailEvery = GetEnv("SDC_FAIL_EVERY");
+	PowerCutAfter = GetEnv("SDC_POWERCUT_AFTER");
+	if(getenv("SDC_INIT_STEPS") != NULL) InitSteps = GetEnv("SDC_INIT_STEPS");
+	memset(&SDC_HostStat, 0, sizeof(SDC_HostStat));
+	return(0);
+}
+
+void SDC_HostClose(void)
+{
+	if(Image != NULL)
+	{
+		msync(Image, ImageSize, MS_SYNC);
+		munmap(Image, ImageSize);
+		Image = NULL;
+	}
+	if(ImageFd >= 0) close(ImageFd);
+	ImageFd = -1;
+}
+
+// simulates the time of one operation and checks for an injected failure
+static uint8_t SDC_HostOperation(uint32_t us)
+{
+	SDC_HostStat.Time_us += us;
+	Host_AdvanceTime(us);
+	Operations++;
+	if(FailEvery && !(Operations % FailEvery))
+	{
+		SDC_HostStat.Failures++;
+		return(0);
+	}
+	return(1);
+}
+
+SD_Result_t SDC_InitStart(void)
+{
+	CardValid = 0;
+	if((Image == NULL) || !SD_SWITCH)
+	{
+		printf("No Card in Slot.");
+		return(SD_ERROR_NOCARD);
+	}
+	printf("\r\n SDC init...");
+	InitStepsLeft = InitSteps;
+	return(SD_PENDING);
+}
+
+SD_Result_t SDC_InitStep(void)
+{
+	if(!SD_SWITCH) return(SD_ERROR_NOCARD);
+	SDC_HostOperation(Latency_us);	// one ACMD41 per step
+	if(InitStepsLeft)
+	{
+		InitStepsLeft--;
+		return(SD_PENDING);
+	}
+	CardValid = 1;
+	printf("ok\r\n  Capacity = %u MB", (unsigned)(ImageSize / (1024L*1024L)));
+	return(SD_SUCCESS);
+}
+
+SD_Result_t SDC_Init(void)
+{
+	SD_Result_t result;
+
+	result = SDC_InitStart();
+	while(result == SD_PENDING) result = SDC_InitStep();
+	return(result);
+}
+
+SD_Result_t SDC_Deinit(void)
+{
+	CardValid = 0;
+	return(SD_SUCCESS);
+}
+
+SD_Result_t SDC_GetSector(uint32_t addr, uint8_t *Buffer)
+{
+	if(!CardValid || !SD_SWITCH) return(SD_ERROR_NOCARD);
+	if(((uint64_t)addr + 1) * 512 > ImageSize) return(SD_ERROR_READ_DATA);
+	SDC_HostStat.Reads++;
+	if(!SDC_HostOperation(Latency_us)) return(SD_ERROR_READ_DATA);
+	memcpy(Buffer, &Image[(size_t)addr * 512], 512);
+	return(SD_SUCCESS);
+}
+
+SD_Result_t SDC_PutSector(uint32_t addr, const uint8_t *Buffer)
+{
+	if(!CardValid || !SD_SWITCH) return(SD_ERROR_NOCARD);
+	if(((uint64_t)addr + 1) * 512 > ImageSize) return(SD_ERROR_WRITE_DATA);
+	if(PowerCutAfter && (SDC_HostStat.Writes + 1 >= PowerCutAfter))
+	{	// the sector is not written and all following writes are lost
+		fprintf(stderr, "\nsdc: power cut before write #%u to sector %u\n", (unsigned)(SDC_HostStat.Writes + 1), (unsigned)addr);
+		_exit(2);
+	}
+	SDC_HostStat.Writes++;
+	if(!SDC_HostOperation(Latency_us + Busy_us)) return(SD_ERROR_WRITE_DATA);
+	memcpy(&Image[(size_t)addr * 512], Buffer, 512);
+	return(SD_SUCCESS);
+}
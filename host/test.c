@@ -0,0 +1,85 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			test.c
+// Description:			Host (Linux) tests of the modules that do not need the card. Each test drives the unmodified module
+//						with simulated input and checks its results, the tests are listed in Tests[] below.
+//
+//						usage: fmtest [name]
+//
+//						Without a name all tests are run. The exit code is the number of failed checks.
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "host.h"
+#include "test.h"
+
+// registers of the host avr/io.h
+volatile uint8_t SREG;
+volatile uint8_t PINB, PORTB, DDRB;
+volatile uint8_t PINC, PORTC, DDRC;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+volatile uint8_t DDRA, PORTA, DIDR0, ADMUX, ADCSRA, ADCSRB;
+volatile uint16_t ADC;
+volatile uint8_t PORTD, DDRD, UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+
+extern void TIMER0_COMPA_vect(void);
+
+typedef struct
+{
+	const char	*Name;
+	uint16_t	(*pTest)(void);
+} Test_t;
+
+Test_t Tests[] =
+{
+	{"clock", Test_Clock},
+	{"fallback", Test_Fallback},
+	{"timer", Test_Timer},
+	{"sched", Test_Sched},
+	{"uart", Test_Uart},
+	{"uartrx", Test_UartRx},
+	{"fat", Test_Fat},
+};
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	_printf_P(char, char const *fmt0, ...);
+//
+// Description:	The output of the modules is suppressed, the tests print their own results.
+//________________________________________________________________________________________________________________________________________
+
+void _printf_P(char dest, char const *fmt0, ...)
+{
+}
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	Host_AdvanceTime(uint32_t us);
+//
+// Description:	The time spent by the disk image (see sdc_image.c) runs the timer 0 isr at its rate of 1 kHz.
+//________________________________________________________________________________________________________________________________________
+
+void Host_AdvanceTime(uint32_t us)
+{
+	static uint32_t acc = 0;
+
+	acc += us;
+	while(acc >= 1000)
+	{
+		acc -= 1000;
+		TIMER0_COMPA_vect();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint16_t i, failed = 0, f;
+
+	for(i = 0; i < sizeof(Tests) / sizeof(Test_t); i++)
+	{
+		if((argc > 1) && strcmp(argv[1], Tests[i].Name)) continue;
+		f = Tests[i].pTest();
+		printf("%-10s %s (%u failed)\n", Tests[i].Name, f ? "FAILED" : "ok", f);
+		failed += f;
+	}
+	return(failed > 255 ? 255 : failed);
+}
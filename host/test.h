@@ -0,0 +1,15 @@
+#ifndef _HOST_TEST_H
+#define _HOST_TEST_H
+
+#include <inttypes.h>
+
+// the tests return the number of failed checks
+extern uint16_t Test_Clock(void);
+extern uint16_t Test_Fallback(void);
+extern uint16_t Test_Timer(void);
+extern uint16_t Test_Sched(void);
+extern uint16_t Test_Uart(void);
+extern uint16_t Test_UartRx(void);
+extern uint16_t Test_Fat(void);
+
+#endif //_HOST_TEST_H
@@ -0,0 +1,146 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			test_clock.c
+// Description:			Test of the system time kept by SetGPSTime() in ubx.c. The time is advanced by random iTOW steps, including
+//						steps of 0, steps larger than TIME_MAX_STEP, day and week rollovers. After every step the incremental result has
+//						to match a full conversion of the same iTOW and week.
+//						The fallback test sends NAV-PVT, stops it until UBX_PVT_TIMEOUT has passed and continues with the legacy
+//						message set late in the week. Every complete set has to be published.
+//						The module is included to reach its internal state, the receiver and the card are stubbed.
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../ubx.c"
+#include "host.h"
+#include "test.h"
+
+#undef printf
+
+#define CLOCK_STEPS		400000L
+
+// the interfaces used by ubx.c
+fifo_t rxFifo;
+volatile uint16_t UbxRxTime;
+int USART1_putc(const uint8_t c) { return(1); }
+uint8_t USART1_TxComplete(void) { return(1); }
+void USART1_SetBaudrate(uint32_t baudrate) { }
+void Aid_Store(uint8_t id, const uint8_t *pData, uint16_t len) { }
+void Logging_UBXData(uint8_t *pData, uint16_t len) { }
+
+// sets the time of the current solution
+static void Clock_SetSolution(uint32_t itow, int16_t week)
+{
+	UbxSol.Status = NEWDATA;
+	UbxSol.Flags = FLAG_WKNSET | FLAG_TOWSET;
+	UbxSol.itow = itow;
+	UbxSol.week = week;
+}
+
+uint16_t Test_Clock(void)
+{
+	DateTime_t inc, ref;
+	uint32_t itow = 6 * 86400000L + 86000000L, step; // shortly before the end of the week
+	int16_t week = 2000;
+	uint32_t saved_itow;
+	int16_t saved_week;
+	long k, failed = 0;
+	int r;
+
+	memset(&inc, 0, sizeof(inc));
+	srand(1);
+	for(k = 0; k < CLOCK_STEPS; k++)
+	{
+		r = rand() % 1000;
+		if(r < 2) step = 20000;			// larger than TIME_MAX_STEP
+		else if(r < 4) step = 0;		// same epoch again
+		else if(r < 500) step = 100;	// 10 Hz
+		else step = rand() % 3000 + 1;
+		itow += step;
+		if(itow >= 604800000L)
+		{
+			itow -= 604800000L;
+			week++;
+		}
+		Clock_SetSolution(itow, week);
+		SetGPSTime(&inc);
+		// full conversion of the same solution
+		saved_itow = Time_Itow;
+		saved_week = Time_Week;
+		Time_Synced = 0;
+		ref = inc;
+		ref.Valid = 0;
+		SetGPSTime(&ref);
+		Time_Synced = 1;
+		Time_Itow = saved_itow;
+		Time_Week = saved_week;
+		if(memcmp(&inc, &ref, sizeof(ref)))
+		{
+			if(failed++ < 5) printf("clock: itow %lu week %d: %02d:%02d:%02d.%03d, expected %02d:%02d:%02d.%03d\n",
+				(unsigned long)itow, week, inc.Hour, inc.Min, inc.Sec, inc.mSec, ref.Hour, ref.Min, ref.Sec, ref.mSec);
+		}
+	}
+	printf("clock: %ld steps, last %04d-%02d-%02d %02d:%02d:%02d.%03d\n", CLOCK_STEPS,
+		inc.Year, inc.Month, inc.Day, inc.Hour, inc.Min, inc.Sec, inc.mSec);
+	return(failed > 65535 ? 65535 : (uint16_t)failed);
+}
+
+// receives the legacy message set of an epoch
+static void Clock_LegacySet(uint32_t itow)
+{
+	UbxSol.Status = NEWDATA;
+	UbxSol.Flags = FLAG_WKNSET | FLAG_TOWSET;
+	UbxSol.itow = itow;
+	UbxSol.week = 2000;
+	Update_GPSData(UBX_ID_SOL);
+	UbxPosLlh.Status = NEWDATA;
+	UbxPosLlh.itow = itow;
+	Update_GPSData(UBX_ID_POSLLH);
+	UbxVelNed.Status = NEWDATA;
+	UbxVelNed.itow = itow;
+	Update_GPSData(UBX_ID_VELNED);
+}
+
+uint16_t Test_Fallback(void)
+{
+	uint32_t itow = 5 * 86400000L;	// later than half a week
+	uint16_t failed = 0, published = 0, mismatch;
+	uint8_t k;
+
+	GPSData.Status = PROCESSED;
+	UbxPvt.Status = NEWDATA;
+	UbxPvt.itow = itow;
+	Update_GPSData(UBX_ID_PVT);
+	if(GPSData.Status != NEWDATA) failed++;
+	GPSData.Status = PROCESSED;
+	// no NAV-PVT any more
+	for(k = 0; k < UBX_PVT_TIMEOUT / 100 + 1; k++)
+	{
+		Host_AdvanceTime(100000L);
+		Timer_Update();
+	}
+	if(Pvt_Active)
+	{
+		printf("fallback: NAV-PVT still active\n");
+		failed++;
+	}
+	mismatch = UbxStat.EpochMismatch;
+	for(k = 0; k < 20; k++)
+	{
+		itow += 200;
+		Clock_LegacySet(itow);
+		if(GPSData.Status == NEWDATA) published++;
+		GPSData.Status = PROCESSED;
+	}
+	// a message of an older epoch is still dropped
+	UbxSol.Status = NEWDATA;
+	UbxSol.itow = itow - 200;
+	Update_GPSData(UBX_ID_SOL);
+	if((published != 20) || (UbxStat.EpochMismatch != mismatch + 1))
+	{
+		printf("fallback: %u of 20 sets published, %u messages dropped\n", published, UbxStat.EpochMismatch - mismatch);
+		failed++;
+	}
+	printf("fallback: %u legacy sets at itow %lu after NAV-PVT\n", published, (unsigned long)itow);
+	return(failed);
+}
@@ -0,0 +1,127 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			test_fat.c
+// Description:			Test of fat16.c against a disk image (see sdc_image.c). The image is formatted by the test with a small FAT16
+//						file system. An existing file is reopened with 'w' while the lowest free cluster is not its first one, as after
+//						logs have been deleted on a pc. The directory entry has to point to the new content afterwards, and a file
+//						created later must not share a cluster with the rewritten one.
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fat16.h"
+#include "host.h"
+#include "test.h"
+
+#define FAT_IMAGE_SECTORS	4096	// 2 MB, one sector per cluster
+#define FAT_SECTORS			16		// 4096 clusters * 2 bytes
+#define FAT_ROOT_ENTRIES	512
+
+// writes a FAT16 file system without a partition table, the vbr is in sector 0
+static uint8_t Fat_Format(const char *pName)
+{
+	uint8_t sector[512];
+	FILE *fp = fopen(pName, "wb");
+
+	if(fp == NULL) return(0);
+	memset(sector, 0, sizeof(sector));
+	sector[0] = 0xEB; sector[1] = 0x3C; sector[2] = 0x90;
+	memcpy(&sector[3], "FMTEST  ", 8);
+	sector[11] = 0x00; sector[12] = 0x02;								// bytes per sector
+	sector[13] = 1;														// sectors per cluster
+	sector[14] = 1;														// reserved sectors
+	sector[16] = 2;														// fat copies
+	sector[17] = FAT_ROOT_ENTRIES & 0xFF; sector[18] = FAT_ROOT_ENTRIES >> 8;
+	sector[19] = FAT_IMAGE_SECTORS & 0xFF; sector[20] = FAT_IMAGE_SECTORS >> 8;
+	sector[21] = 0xF8;													// media descriptor
+	sector[22] = FAT_SECTORS;											// sectors per fat
+	sector[32] = FAT_IMAGE_SECTORS & 0xFF; sector[33] = FAT_IMAGE_SECTORS >> 8;
+	sector[38] = 0x29;
+	memcpy(&sector[43], "FMTEST     ", 11);
+	memcpy(&sector[54], "FAT16   ", 8);
+	sector[510] = 0x55; sector[511] = 0xAA;
+	fwrite(sector, 1, sizeof(sector), fp);
+	memset(sector, 0, sizeof(sector));
+	for(int i = 1; i < FAT_IMAGE_SECTORS; i++)
+	{
+		if((i == 1) || (i == 1 + FAT_SECTORS))	// media descriptor and end of chain in both fats
+		{
+			sector[0] = 0xF8; sector[1] = 0xFF; sector[2] = 0xFF; sector[3] = 0xFF;
+		}
+		else memset(sector, 0, 4);
+		fwrite(sector, 1, sizeof(sector), fp);
+	}
+	fclose(fp);
+	return(1);
+}
+
+// writes len bytes of the pattern into a new or truncated file
+static uint8_t Fat_Write(char *pName, uint8_t pattern, uint16_t len)
+{
+	uint8_t data[512];
+	File_t *file = fopen_((int8_t *)pName, 'w');
+	uint16_t n;
+
+	if(file == NULL) return(0);
+	memset(data, pattern, sizeof(data));
+	while(len)
+	{
+		n = (len > sizeof(data)) ? sizeof(data) : len;
+		if(fwrite_(data, 1, n, file) != n) break;
+		len -= n;
+	}
+	return((fclose_(file) == 0) && !len);
+}
+
+// checks that the file holds len bytes of the pattern
+static uint8_t Fat_Check(char *pName, uint8_t pattern, uint16_t len)
+{
+	File_t *file = fopen_((int8_t *)pName, 'r');
+	uint16_t read = 0;
+	int16_t c;
+
+	if(file == NULL) return(0);
+	while((c = fgetc_(file)) == pattern) read++;
+	fclose_(file);
+	if(read != len) printf("fat: %s: %u bytes of 0x%02X, expected %u\n", pName, read, pattern, len);
+	return(read == len);
+}
+
+uint16_t Test_Fat(void)
+{
+	char image[] = "/tmp/fmtest_fat.img";
+	uint16_t failed = 0;
+
+	if(!Fat_Format(image) || SDC_HostOpen(image) || Fat16_Init())
+	{
+		printf("fat: image %s could not be mounted\n", image);
+		return(1);
+	}
+	// log1 takes the lowest clusters, the aid file the ones behind
+	failed += !Fat_Write("log1.txt", 0x11, 2000);
+	failed += !Fat_Write("aid.dat", 0x22, 1000);
+	failed += !Fat_Write("log2.txt", 0x33, 1000);
+	// rewriting log1 leaves free clusters before the aid file
+	failed += !Fat_Write("log1.txt", 0x44, 100);
+	// the aid file gets its new first cluster from that gap
+	failed += !Fat_Write("aid.dat", 0x55, 1500);
+	failed += !Fat_Check("aid.dat", 0x55, 1500);
+	// a new file takes the clusters freed by the aid file
+	failed += !Fat_Write("log3.txt", 0x66, 3000);
+	failed += !Fat_Check("aid.dat", 0x55, 1500);
+	failed += !Fat_Check("log3.txt", 0x66, 3000);
+	// the next rewrite must free only the clusters of the aid file
+	failed += !Fat_Write("aid.dat", 0x77, 700);
+	failed += !Fat_Write("log4.txt", 0x88, 2500);
+	failed += !Fat_Check("aid.dat", 0x77, 700);
+	failed += !Fat_Check("log1.txt", 0x44, 100);
+	failed += !Fat_Check("log2.txt", 0x33, 1000);
+	failed += !Fat_Check("log3.txt", 0x66, 3000);
+	failed += !Fat_Check("log4.txt", 0x88, 2500);
+	Fat16_Deinit();
+	SDC_HostClose();
+	unlink(image);
+	printf("fat: files rewritten with 'w' on a fragmented fat\n");
+	return(failed);
+}
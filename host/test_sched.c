@@ -0,0 +1,175 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			test_sched.c
+// Description:			Test of the cooperative scheduler in sched.c with a task table like the one in main.c. The tasks spend
+//						simulated time, the timer interrupt is called for every ms that passes. GPS data arrive at random times
+//						once per 100 ms. They have to be served within the longest slice of a task with a lower priority, and no
+//						periodic task may miss its deadline. The load has to match the time spent by the tasks, and the cpu may
+//						wake up at most once per idle ms. Sched_Idle() must not sleep if a task became ready after Sched_Run().
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "timer0.h"
+#include "sched.h"
+#include "test.h"
+
+#define SCHED_RUN_MS		60000L
+#define SCHED_GPS_PERIOD	100		// ms between two gps messages
+#define SCHED_GPS_SLICE		300		// us
+#define SCHED_LOG_SLICE		4000	// us, the longest slice
+#define SCHED_DEBUG_SLICE	200		// us
+
+extern void TIMER0_COMPA_vect(void);
+
+static uint16_t Sched_SubTime = 0;		// us within the current ms
+static uint32_t Sched_GpsNext = 0;		// arrival of the next gps message
+static uint32_t Sched_GpsArrival = 0;
+static uint8_t  Sched_GpsPending = 0;
+static uint32_t Sched_GpsMaxWait = 0;
+static uint32_t Sched_GpsServed = 0;
+
+// the timer interrupt of the next ms and the gps data that arrive with it
+static void Sched_Tick(void)
+{
+	uint32_t now;
+
+	TIMER0_COMPA_vect();
+	now = GetMilliseconds();
+	if(now == Sched_GpsNext)
+	{
+		Sched_GpsPending = 1;
+		Sched_GpsArrival = now;
+		Sched_GpsNext += SCHED_GPS_PERIOD - 20 + rand() % 41;
+	}
+}
+
+// the cpu is busy for the time in us, timer 0 counts the us within the ms for GetMicroseconds()
+static void Sched_Spend(uint16_t us)
+{
+	Sched_SubTime += us;
+	while(Sched_SubTime >= 1000)
+	{
+		Sched_SubTime -= 1000;
+		Sched_Tick();
+	}
+	TCNT0 = (uint8_t)((Sched_SubTime * (F_CPU / 1000000UL)) / 64);
+}
+
+// the idle sleep ends with the next interrupt
+void Host_Sleep(void)
+{
+	Sched_SubTime = 0;
+	TCNT0 = 0;
+	Sched_Tick();
+}
+
+static uint8_t Sched_GpsReady(void)
+{
+	return(Sched_GpsPending);
+}
+
+static void Sched_Gps(void)
+{
+	uint32_t wait;
+
+	if(Sched_GpsPending)
+	{
+		wait = GetMilliseconds() - Sched_GpsArrival;
+		if(wait > Sched_GpsMaxWait) Sched_GpsMaxWait = wait;
+		Sched_GpsPending = 0;
+		Sched_GpsServed++;
+	}
+	Sched_Spend(SCHED_GPS_SLICE);
+}
+
+static void Sched_Timer(void)
+{
+	Timer_Update();
+}
+
+static void Sched_Log(void)
+{
+	Sched_Spend(SCHED_LOG_SLICE);
+}
+
+static void Sched_Debug(void)
+{
+	Sched_Spend(SCHED_DEBUG_SLICE);
+}
+
+static Task_t Sched_TestTasks[] =
+{
+	//pTask       , pReady        , Period, Deadline
+	{Sched_Gps    , Sched_GpsReady,     10,        5},
+	{Sched_Timer  , NULL          ,      1,       10},
+	{Sched_Log    , NULL          ,     10,      200},
+	{Sched_Debug  , NULL          ,    100,      200}
+};
+#define SCHED_TEST_TASKS	(sizeof(Sched_TestTasks) / sizeof(Task_t))
+
+uint16_t Test_Sched(void)
+{
+	uint16_t failed = 0, load;
+	uint32_t now;
+	uint8_t i;
+
+	srand(1);
+	TIMER0_Init();
+	Sched_GpsNext = SCHED_GPS_PERIOD;
+	Sched_Init(Sched_TestTasks, SCHED_TEST_TASKS);
+	while(GetMilliseconds() < SCHED_RUN_MS)
+	{
+		if(!Sched_Run()) Sched_Idle();
+	}
+	for(i = 0; i < SCHED_TEST_TASKS; i++)
+	{
+		if(TaskStat[i].Misses)
+		{
+			printf("sched: task %u missed %u deadlines\n", i, TaskStat[i].Misses);
+			failed++;
+		}
+	}
+	// a gps message waits at most for the slice in progress and the ms tick it arrived with
+	if(Sched_GpsMaxWait > SCHED_LOG_SLICE / 1000 + 1)
+	{
+		printf("sched: gps waited %lu ms\n", (unsigned long)Sched_GpsMaxWait);
+		failed++;
+	}
+	if(Sched_GpsServed < SCHED_RUN_MS / (SCHED_GPS_PERIOD + 20))
+	{
+		printf("sched: only %lu gps messages served\n", (unsigned long)Sched_GpsServed);
+		failed++;
+	}
+	if(TaskStat[2].MaxTime < SCHED_LOG_SLICE - 1000)
+	{
+		printf("sched: max time of the log slice %u us\n", TaskStat[2].MaxTime);
+		failed++;
+	}
+	// load of the slices per second in %
+	load = ((uint32_t)SCHED_LOG_SLICE * (1000 / 10) + (uint32_t)SCHED_GPS_SLICE * (1000 / 10) + (uint32_t)SCHED_DEBUG_SLICE * (1000 / 100)) / 10000;
+	if((SchedStat.Load + 1 < load) || (SchedStat.Load > load + 1))
+	{
+		printf("sched: load %u %%, expected %u %%\n", SchedStat.Load, load);
+		failed++;
+	}
+	// one wakeup per ms tick that is not covered by a logging slice
+	if(!SchedStat.Wakeups || (SchedStat.Wakeups > 1000 - SCHED_LOG_SLICE / 10))
+	{
+		printf("sched: %u wakeups/s, expected at most %u\n", SchedStat.Wakeups, 1000 - SCHED_LOG_SLICE / 10);
+		failed++;
+	}
+	// data that arrived after the last check of Sched_Run()
+	Sched_GpsPending = 1;
+	now = GetMilliseconds();
+	Sched_Idle();
+	if(GetMilliseconds() != now)
+	{
+		printf("sched: idle sleep with a ready task\n");
+		failed++;
+	}
+	Sched_GpsPending = 0;
+	printf("sched: %lu gps messages, max wait %lu ms, log slice max %u us\n",
+		(unsigned long)Sched_GpsServed, (unsigned long)Sched_GpsMaxWait, TaskStat[2].MaxTime);
+	printf("sched: load %u %%, %u.%u mA, %u wakeups/s\n", SchedStat.Load, SchedStat.Current / 10, SchedStat.Current % 10, SchedStat.Wakeups);
+	return(failed);
+}
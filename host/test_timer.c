@@ -0,0 +1,118 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			test_timer.c
+// Description:			Test of the time base and the timer wheel in timer0.c. The timer interrupt is called once per simulated ms.
+//						Periodic timers from 1 ms to 30 min have to fire at their exact interval over 4000 s, also while another
+//						timer is restarted from a callback, and the us capture has to be monotonic. Then Timer_Update() is called
+//						only every 37 ms, as after a long task, and the missed expiries have to be caught up.
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include "timer0.h"
+#include "test.h"
+
+#define TIMER_RUN_MS		4000000L
+#define TIMER_LATE_MS		100000L
+#define TIMER_LATE_UPDATE	37
+#define TIMER_COUNT			6
+
+extern void TIMER0_COMPA_vect(void);
+
+static const uint32_t Timer_Interval[TIMER_COUNT] = {1, 7, 16, 1000, 100000L, 1800000L};
+static Timer_t Timer[TIMER_COUNT], Timer_Once;
+static uint32_t Timer_Fires[TIMER_COUNT], Timer_Last[TIMER_COUNT], Timer_Errors[TIMER_COUNT];
+static uint32_t Timer_OnceFires;
+static uint8_t Timer_CheckInterval;
+
+static void Timer_Fire(uint8_t i)
+{
+	uint32_t now = GetMilliseconds();
+
+	if(Timer_CheckInterval && Timer_Fires[i] && (now - Timer_Last[i] != Timer_Interval[i])) Timer_Errors[i]++;
+	Timer_Last[i] = now;
+	Timer_Fires[i]++;
+}
+
+static void Timer_Fire0(void) { Timer_Fire(0); }
+static void Timer_Fire1(void) { Timer_Fire(1); }
+static void Timer_Fire2(void) { Timer_Fire(2); }
+static void Timer_Fire3(void) { Timer_Fire(3); }
+static void Timer_Fire4(void) { Timer_Fire(4); }
+static void Timer_Fire5(void) { Timer_Fire(5); }
+
+static void (* const Timer_Callback[TIMER_COUNT])(void) = {Timer_Fire0, Timer_Fire1, Timer_Fire2, Timer_Fire3, Timer_Fire4, Timer_Fire5};
+
+// restarts timer 1 from within a callback
+static void Timer_FireOnce(void)
+{
+	Timer_OnceFires++;
+	Timer_Start(&Timer[1], Timer_Interval[1], Timer_Interval[1], Timer_Callback[1]);
+	Timer_Fires[1] = 0;
+}
+
+uint16_t Test_Timer(void)
+{
+	uint32_t ms, us, last_us = 0, expected;
+	uint16_t failed = 0, nonmono = 0;
+	uint8_t i;
+
+	TIMER0_Init();
+	for(i = 0; i < TIMER_COUNT; i++) Timer_Start(&Timer[i], Timer_Interval[i], Timer_Interval[i], Timer_Callback[i]);
+	Timer_Start(&Timer_Once, 40000L, 0, Timer_FireOnce);
+	Timer_CheckInterval = 1;
+	for(ms = 0; ms < TIMER_RUN_MS; ms++)
+	{
+		TIMER0_COMPA_vect();
+		us = GetMicroseconds();
+		if(us < last_us) nonmono++;
+		last_us = us;
+		Timer_Update();
+	}
+	for(i = 0; i < TIMER_COUNT; i++)
+	{
+		expected = (i == 1) ? (TIMER_RUN_MS - 40000L) / Timer_Interval[i] : TIMER_RUN_MS / Timer_Interval[i];
+		if((Timer_Fires[i] != expected) || Timer_Errors[i])
+		{
+			printf("timer: interval %lu ms fired %lu times, expected %lu, %lu wrong intervals\n",
+				(unsigned long)Timer_Interval[i], (unsigned long)Timer_Fires[i], (unsigned long)expected, (unsigned long)Timer_Errors[i]);
+			failed++;
+		}
+	}
+	if(Timer_OnceFires != 1)
+	{
+		printf("timer: single shot fired %lu times\n", (unsigned long)Timer_OnceFires);
+		failed++;
+	}
+	if(nonmono)
+	{
+		printf("timer: us capture went back %u times\n", nonmono);
+		failed++;
+	}
+	if(CountMilliseconds != (uint16_t)TIMER_RUN_MS)
+	{
+		printf("timer: CountMilliseconds %u, expected %u\n", CountMilliseconds, (uint16_t)TIMER_RUN_MS);
+		failed++;
+	}
+
+	// late updates, the intervals are caught up but can not be exact, the count depends on the phase of the timer
+	Timer_CheckInterval = 0;
+	for(i = 0; i < TIMER_COUNT; i++) Timer_Fires[i] = 0;
+	for(ms = 1; ms <= TIMER_LATE_MS; ms++)
+	{
+		TIMER0_COMPA_vect();
+		if(!(ms % TIMER_LATE_UPDATE)) Timer_Update();
+	}
+	Timer_Update();
+	for(i = 0; i < 4; i++)
+	{
+		expected = TIMER_LATE_MS / Timer_Interval[i];
+		if((Timer_Fires[i] < expected) || (Timer_Fires[i] > expected + 1))
+		{
+			printf("timer: late update, interval %lu ms fired %lu times, expected %lu\n",
+				(unsigned long)Timer_Interval[i], (unsigned long)Timer_Fires[i], (unsigned long)(TIMER_LATE_MS / Timer_Interval[i]));
+			failed++;
+		}
+	}
+	for(i = 0; i < TIMER_COUNT; i++) Timer_Stop(&Timer[i]);
+	printf("timer: %lu s, %lu s with late updates\n", TIMER_RUN_MS / 1000, TIMER_LATE_MS / 1000);
+	return(failed);
+}
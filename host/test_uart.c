@@ -0,0 +1,228 @@
+//________________________________________________________________________________________________________________________________________
+// Module name:			test_uart.c
+// Description:			Test of the tx queue of uart0.c. The frames are queued by SendOutData() and encoded by the tx isr, that is
+//						called for every character. The characters on the wire have to be byte for byte identical to the encoding
+//						of the former SendOutData(), that built the complete frame in a buffer, also for payloads larger than its
+//						buffer. A source that changes after its frame has been queued must not change the frame, and the queued
+//						frames have to be sent in the order of their priority.
+//						The receive test sends a burst of 'd' frames at 57600 baud to the rx isr, while the serial task processes
+//						them every 2 ms. Every 100 ms the task can be stalled, as by a write to the card.
+//________________________________________________________________________________________________________________________________________
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include "uart0.h"
+#include "gps.h"
+#include "menu.h"
+#include "test.h"
+
+#define UART_DATA_LEN		240		// the former SendOutData() was limited to 108 bytes
+#define UART_WIRE_LEN		((UART_DATA_LEN + 2) / 3 * 4 + 6)
+#define UART_RX_FRAMES		200		// frames of the burst
+#define UART_RX_BYTE_TIME	174		// us per character at 57600 baud, 8N1
+#define UART_RX_TASK		2000	// us, period of the serial task
+#define UART_RX_STALL		8000	// us, delay of the serial task every 100 ms
+
+extern void USART0_TX_vect(void);
+extern void USART0_RX_vect(void);
+extern uint16_t DebugData_Interval;
+extern uint8_t Request_DebugData, Request_Display1;
+extern uint8_t SendOutData(uint8_t prio, uint8_t cmd, uint8_t addr, uint8_t numofbuffers, ...);
+extern volatile uint8_t TxActive;
+
+// the interfaces used by uart0.c
+int8_t DisplayBuff[DISPLAYBUFFSIZE];
+uint8_t MenuItem = 3;
+uint8_t MaxMenuItem = 7;
+uint8_t Uart_MenuPage = 0;
+void Menu_Update(uint8_t Keys)	// every update shows the next page
+{
+	memset(DisplayBuff, 'a' + Uart_MenuPage++, sizeof(DisplayBuff));
+}
+GPS_Latency_t GPS_Latency;
+GPS_Stamp_t GPS_FollowMeStamp;
+volatile uint8_t GPS_FollowMeTxState = FM_TX_IDLE;
+
+// the encoding of the former SendOutData(), returns the length of the frame
+static uint16_t Uart_Encode(uint8_t *pFrame, uint8_t cmd, uint8_t addr, const uint8_t *pData, uint8_t len)
+{
+	uint16_t pt = 0, crc = 0, i;
+	uint8_t a, b, c;
+
+	pFrame[pt++] = '#';
+	pFrame[pt++] = 'a' + addr;
+	pFrame[pt++] = cmd;
+	while(len)
+	{
+		a = *pData++; len--;
+		if(len) { b = *pData++; len--; } else b = 0;
+		if(len) { c = *pData++; len--; } else c = 0;
+		pFrame[pt++] = '=' + (a >> 2);
+		pFrame[pt++] = '=' + (((a & 0x03) << 4) | ((b & 0xf0) >> 4));
+		pFrame[pt++] = '=' + (((b & 0x0f) << 2) | ((c & 0xc0) >> 6));
+		pFrame[pt++] = '=' + ( c & 0x3f);
+	}
+	for(i = 0; i < pt; i++) crc += pFrame[i];
+	crc %= 4096;
+	pFrame[pt++] = '=' + crc / 64;
+	pFrame[pt++] = '=' + crc % 64;
+	pFrame[pt++] = '\r';
+	return(pt);
+}
+
+// runs the tx isr until the queue is empty, returns the number of characters sent
+static uint16_t Uart_Drain(uint8_t *pWire, uint16_t size)
+{
+	uint16_t n = 0;
+
+	while(TxActive < TXD_FRAMES)
+	{
+		if(n < size) pWire[n] = UDR0;
+		n++;
+		USART0_TX_vect();
+	}
+	return(n);
+}
+
+static uint16_t Uart_Compare(const char *pName, const uint8_t *pWire, uint16_t wirelen, const uint8_t *pExpected, uint16_t len)
+{
+	if((wirelen == len) && !memcmp(pWire, pExpected, len)) return(0);
+	printf("uart: %s: %u characters sent, %u expected\n", pName, wirelen, len);
+	return(1);
+}
+
+uint16_t Test_Uart(void)
+{
+	static uint8_t wire[4 * UART_WIRE_LEN], expected[4 * UART_WIRE_LEN];
+	uint8_t data[UART_DATA_LEN];
+	uint16_t failed = 0, n, len, wirelen;
+	uint8_t i;
+
+	srand(1);
+	USART0_Init();
+	for(i = 0; i < UART_DATA_LEN; i++) data[i] = (uint8_t)rand();
+	// every payload length as one buffer and split into three buffers
+	for(len = 0; len <= UART_DATA_LEN; len++)
+	{
+		n = Uart_Encode(expected, 'D', 1, data, len);
+		SendOutData(TX_PRIO_TELEMETRY, 'D', 1, 1, data, len);
+		wirelen = Uart_Drain(wire, sizeof(wire));
+		failed += Uart_Compare("one buffer", wire, wirelen, expected, n);
+		SendOutData(TX_PRIO_REPLY, 'D', 1, 3, data, len / 3, &data[len / 3], len / 2 - len / 3, &data[len / 2], len - len / 2);
+		wirelen = Uart_Drain(wire, sizeof(wire));
+		failed += Uart_Compare("three buffers", wire, wirelen, expected, n);
+	}
+	// a frame with more buffers than a frame can hold is not sent
+	if(SendOutData(TX_PRIO_REPLY, 'D', 1, TXD_BUFFERS + 1, data, 1, data, 1, data, 1, data, 1) || (TxActive < TXD_FRAMES))
+	{
+		printf("uart: frame with %u buffers sent\n", TXD_BUFFERS + 1);
+		failed++;
+	}
+	Uart_Drain(wire, sizeof(wire));
+	// the 'L' frame is sent from the display buffer, the next page is not shown until the frame has been sent
+	data[0] = MenuItem;
+	data[1] = MaxMenuItem;
+	memset(&data[2], 'a', DISPLAYBUFFSIZE);
+	n  = Uart_Encode(&expected[0], 'L', 1, data, DISPLAYBUFFSIZE + 2);
+	memset(&data[2], 'b', DISPLAYBUFFSIZE);
+	n += Uart_Encode(&expected[n], 'L', 1, data, DISPLAYBUFFSIZE + 2);
+	Request_Display1 = 1;
+	USART0_TransmitTxData();
+	Request_Display1 = 1;
+	USART0_TransmitTxData();
+	wirelen = Uart_Drain(wire, sizeof(wire));
+	USART0_TransmitTxData();
+	wirelen += Uart_Drain(&wire[wirelen], sizeof(wire) - wirelen);
+	failed += Uart_Compare("display", wire, wirelen, expected, n);
+	// the debug data is sent from a snapshot, a change of DebugOut after queuing goes out with the next frame
+	memset(&DebugOut, 0x11, sizeof(DebugOut));
+	n  = Uart_Encode(&expected[0], 'D', 10, (uint8_t *)&DebugOut, sizeof(DebugOut));
+	Request_DebugData = 1;
+	USART0_TransmitTxData();
+	memset(&DebugOut, 0x22, sizeof(DebugOut));
+	n += Uart_Encode(&expected[n], 'D', 10, (uint8_t *)&DebugOut, sizeof(DebugOut));
+	Request_DebugData = 1;
+	USART0_TransmitTxData();
+	wirelen = Uart_Drain(wire, sizeof(wire));
+	USART0_TransmitTxData();
+	wirelen += Uart_Drain(&wire[wirelen], sizeof(wire) - wirelen);
+	failed += Uart_Compare("changed source", wire, wirelen, expected, n);
+	// while a telemetry frame is on the wire, the follow me frame is sent before the reply and the reply before the next telemetry
+	for(i = 0; i < UART_DATA_LEN; i++) data[i] = (uint8_t)rand();
+	n  = Uart_Encode(&expected[0], 'D', 10, data, 66);
+	n += Uart_Encode(&expected[n], 's', 2, &data[1], 30);
+	n += Uart_Encode(&expected[n], 'V', 10, &data[2], 10);
+	n += Uart_Encode(&expected[n], 'D', 10, &data[3], 66);
+	SendOutData(TX_PRIO_TELEMETRY, 'D', 10, 1, data, 66);
+	SendOutData(TX_PRIO_TELEMETRY, 'D', 10, 1, &data[3], 66);
+	SendOutData(TX_PRIO_REPLY, 'V', 10, 1, &data[2], 10);
+	SendOutData(TX_PRIO_FOLLOWME, 's', 2, 1, &data[1], 30);
+	wirelen = Uart_Drain(wire, sizeof(wire));
+	failed += Uart_Compare("priorities", wire, wirelen, expected, n);
+	printf("uart: %u payload lengths, too many buffers, display, changed source, priorities\n", UART_DATA_LEN + 1);
+	return(failed);
+}
+
+// sends the burst, returns the number of frames processed in order
+static uint16_t Uart_RxBurst(uint16_t stall)
+{
+	static uint8_t stream[UART_RX_FRAMES * 10];
+	uint16_t len = 0, sent = 0, last = 0, processed = 0;
+	uint32_t t, next_task = 0;
+	uint8_t value;
+
+	USART0_Init();
+	UART_RxStat.Frames = 0;
+	UART_RxStat.CRCErrors = 0;
+	UART_RxStat.Overruns = 0;
+	UART_RxStat.Dropped = 0;
+	for(value = 1; value <= UART_RX_FRAMES; value++) len += Uart_Encode(&stream[len], 'd', 10, &value, 1);
+	for(t = 0; t < (uint32_t)len * UART_RX_BYTE_TIME + 50000L; t++)
+	{
+		if((sent < len) && (t >= (uint32_t)sent * UART_RX_BYTE_TIME))
+		{
+			UDR0 = stream[sent++];
+			USART0_RX_vect();
+		}
+		if(t >= next_task)
+		{
+			DebugData_Interval = 0;
+			USART0_ProcessRxData();
+			// the interval is set by the last 'd' frame processed
+			if(DebugData_Interval)
+			{
+				if(DebugData_Interval / 10 <= last) return(0); // out of order
+				last = DebugData_Interval / 10;
+			}
+			if(stall && ((t / 1000) % 100 < 2)) next_task += stall;
+			else next_task += UART_RX_TASK;
+		}
+	}
+	processed = UART_RxStat.Frames;
+	if(UART_RxStat.CRCErrors || UART_RxStat.Overruns || (processed + UART_RxStat.Dropped != UART_RX_FRAMES)) return(0);
+	return(processed);
+}
+
+uint16_t Test_UartRx(void)
+{
+	uint16_t failed = 0, processed, stalled;
+
+	processed = Uart_RxBurst(0);
+	stalled = Uart_RxBurst(UART_RX_STALL);
+	// all frames without a stall, a few are dropped while the task is stalled
+	if(processed != UART_RX_FRAMES)
+	{
+		printf("uartrx: %u of %u frames processed\n", processed, UART_RX_FRAMES);
+		failed++;
+	}
+	if(stalled < UART_RX_FRAMES * 9 / 10)
+	{
+		printf("uartrx: %u of %u frames processed with a stalled task\n", stalled, UART_RX_FRAMES);
+		failed++;
+	}
+	printf("uartrx: %u buffers, %u of %u frames, %u with a %u ms stall every 100 ms\n", RXD_FRAMES, processed, UART_RX_FRAMES,
+		stalled, UART_RX_STALL / 1000);
+	return(failed);
+}
@@ -373,7 +373,7 @@ uint8_t KML_LineStringAddPoint(KML_Document_t *doc)
 				sign = '+';
 				sprintf(string,"%c%d.%.3d",sign, 0, 0);
 				fputs_(string, doc->file);
-				retvalue = 1;
+				if(!ferror_(doc->file)) retvalue = 1; // the card may have been removed
 			}
 		}
 	}
@@ -79,14 +79,24 @@ typedef enum
 // logger handler prototypes
 logfilestate_t Logging_KML(uint16_t LogDelay);
 //logfilestate_t Logging_GPX(uint16_t LogDelay);
+logfilestate_t Logging_UBX(uint16_t Enabled);
 
 typedef struct
 {
  	uint16_t KML_Interval;  // the kml-log interval (0 = off)
 	uint16_t GPX_Interval;  // the gpx-log interval (0 = off)
+	uint16_t UBX_Enabled;   // the raw data of the gps receiver are logged (0 = off)
 } LogCfg_t;
 
-LogCfg_t LogCfg = {500 , 1000};
+LogCfg_t LogCfg = {500 , 1000, 0};
+
+// the file of the raw ubx log, the ubx parser hands over the data by Logging_UBXData()
+// and they are written to the card by Logging_UBX() to keep the parser from stalling on a card access
+#define UBX_LOG_BUFFER_LEN	512		// about 130 ms at 38400 baud, must be a power of two
+File_t *UBX_LogFile = NULL;
+uint8_t UBX_LogError = 0;
+fifo_t UBX_LogFifo;
+uint8_t UBX_LogBuffer[UBX_LOG_BUFFER_LEN];
 
 
 //----------------------------------------------------------------------------------------------------
@@ -139,6 +149,30 @@ int8_t* GenerateGPXLogFileName(void)
 	else return NULL;
 }
 
+//----------------------------------------------------------------------------------------------------
+int8_t* GenerateUBXLogFileName(void)
+{
+	static uint16_t filenum = 0;	// file name counter
+	static int8_t filename[35];
+	static DateTime_t LastTime = {0,0,0,0,0,0,0,0};
+
+	if(SystemTime.Valid)
+	{
+		// if the day has been changed
+		if((LastTime.Year != SystemTime.Year) || (LastTime.Month != SystemTime.Month) || (LastTime.Day != SystemTime.Day))
+		{
+			LastTime.Year = SystemTime.Year;
+			LastTime.Month = SystemTime.Month;
+			LastTime.Day = SystemTime.Day;
+			LastTime.Valid = 1;
+			filenum = 0; // reset file counter
+		}
+		sprintf(filename, "LOG/%04i%02i%02i/UBX/GPS%05i.UBX", SystemTime.Year, SystemTime.Month, SystemTime.Day, filenum);
+		filenum++;
+		return filename;
+	}
+	else return NULL;
+}
 
 //----------------------------------------------------------------------------------------------------
 // logs the current gps position to a kml file
@@ -386,6 +420,134 @@ logfilestate_t Logging_GPX(uint16_t LogDelay)
 	return logfilestate;
 }
 
+//----------------------------------------------------------------------------------------------------
+// appends the bytes received from the gps to the raw ubx log file,
+// called by the ubx parser with the span of the receive fifo it has parsed
+void Logging_UBXData(uint8_t *pData, uint16_t len)
+{
+	if((UBX_LogFile == NULL) || UBX_LogError) return;
+	fifo_put_bulk(&UBX_LogFifo, pData, len); // bytes that do not fit are counted as overflow
+}
+
+// writes the buffered raw data to the file
+static void Logging_UBXWrite(void)
+{
+	uint8_t *pdata;
+	uint16_t len;
+
+	while((len = fifo_get_span(&UBX_LogFifo, &pdata)) != 0)
+	{
+		if(fwrite_(pdata, len, 1, UBX_LogFile) != 1) UBX_LogError = 1;
+		fifo_release(&UBX_LogFifo, len);
+	}
+}
+
+//----------------------------------------------------------------------------------------------------
+// opens and closes the raw ubx log file and writes the data buffered by Logging_UBXData()
+logfilestate_t Logging_UBX(uint16_t Enabled)
+{
+	static 	logfilestate_t logfilestate = LOGFILE_IDLE; // the current logfilestate
+	static	int8_t* logfilename = NULL;					// the pointer to the logfilename
+	static  uint16_t flushtimer = 0;					// the flush timer
+
+	// initialize if Enabled is zero
+	if(!Enabled)
+	{
+		if(UBX_LogFile != NULL) fclose_(UBX_LogFile); // try to close it
+		UBX_LogFile = NULL;
+		UBX_LogError = 0;
+		fifo_init(&UBX_LogFifo, UBX_LogBuffer, UBX_LOG_BUFFER_LEN);
+		logfilestate = LOGFILE_IDLE;
+		logfilename = NULL;
+		return logfilestate;
+	}
+
+	if(SysState == STATE_SEND_FOLLOWME)
+	{
+		switch(logfilestate)
+		{
+			case LOGFILE_IDLE:
+			case LOGFILE_CLOSED:
+				if(SystemTime.Valid) logfilestate = LOGFILE_START; // the date is needed for the file name
+				break;
+			case LOGFILE_START:
+				// find unused logfile name
+				do
+				{	 // try to generate a new logfile name
+				 	 logfilename = GenerateUBXLogFileName();
+				}while((logfilename != NULL) && fexist_(logfilename));
+				// if logfilename exist
+				if(logfilename != NULL)
+				{
+					// try to create the log file
+					fifo_purge(&UBX_LogFifo);
+					UBX_LogFile = fopen_(logfilename, 'a');
+					if(UBX_LogFile != NULL)
+					{
+						UBX_LogError = 0;
+						flushtimer = SetDelay(LOG_FLUSH_INTERVAL);
+						logfilestate = LOGFILE_OPENED; // goto next step
+						printf("\r\nOpening ubx-file: %s\r\n", logfilename);
+					}
+					else // could not be openend
+					{
+						logfilestate = LOGFILE_ERROR;
+						printf("\r\nError opening ubx-file: %s\r\n", logfilename);
+					}
+				}
+				else
+				{
+					logfilestate = LOGFILE_ERROR;
+				 	printf("\r\nError getting free ubx-file name\r\n");
+				}
+				break;
+			case LOGFILE_OPENED:
+				// append the data received since the last call
+				Logging_UBXWrite();
+				if(UBX_LogError)
+				{	// error logging data
+					printf("\r\nError logging to ubx-file\r\n");
+					fclose_(UBX_LogFile);
+					UBX_LogFile = NULL;
+					logfilestate = LOGFILE_ERROR;
+				}
+				else if(CheckDelay(flushtimer))
+				{
+					flushtimer = SetDelay(LOG_FLUSH_INTERVAL);
+					fflush_(UBX_LogFile);
+				}
+				break;
+
+			case LOGFILE_ERROR:
+				break;
+
+			default:
+				logfilestate = LOGFILE_IDLE;
+				break;
+		}
+	} // EOF follow me on
+	else // follow me off
+	{   // close log file if opened
+		if(logfilestate == LOGFILE_OPENED)
+		{
+			Logging_UBXWrite();
+			if((fclose_(UBX_LogFile) == 0) && !UBX_LogError)
+			{
+				printf("\r\nClosing ubx-file\r\n");
+				logfilestate = LOGFILE_CLOSED;
+			}
+			else  // could not be closed
+			{
+				printf("\r\nError closing ubx-file\r\n");
+				logfilestate =  LOGFILE_ERROR;
+			}
+			UBX_LogFile = NULL;
+		}
+	} //EOF follow me off
+
+	return logfilestate;
+}
+
 //----------------------------------------------------------------------------------------------------
 // initialize logging
 void Logging_Init(void)
@@ -396,6 +558,9 @@ void Logging_Init(void)
 	LogCfg.GPX_Interval = 1000; //default
 	Settings_GetParamValue(PID_GPX_LOGGING, &(LogCfg.GPX_Interval)); // overwrite by settings value
  	Logging_GPX(0);	// initialize
+	LogCfg.UBX_Enabled = 0; //default
+	Settings_GetParamValue(PID_UBX_LOGGING, &(LogCfg.UBX_Enabled)); // overwrite by settings value
+	Logging_UBX(0);	// initialize
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -406,7 +571,7 @@ void Logging_Update(void)
 	static logfilestate_t logstate = LOGFILE_IDLE;
 
 
-	if(SD_SWITCH) // a card is in slot
+	if(Fat16_IsValid()) // a card is in slot and mounted
 	{
 		if(CheckDelay(logtimer))
 		{
@@ -414,11 +579,12 @@ void Logging_Update(void)
 			// call the logger handlers if no error has occured
 			if(logstate != LOGFILE_ERROR) logstate = Logging_KML(LogCfg.KML_Interval);
 			if(logstate != LOGFILE_ERROR) logstate = Logging_GPX(LogCfg.GPX_Interval);
+			if(logstate != LOGFILE_ERROR) logstate = Logging_UBX(LogCfg.UBX_Enabled);
 
 			// a logging error has occured
 			if(logstate == LOGFILE_ERROR)
 			{
-				if(Fat16_IsValid()) // wait for reinizialization of fat16 from outside
+				if(Fat16_IsValid()) // wait for reinizialization of fat16 by Fat16_Update()
 				{
 					Logging_Init(); // initialize the logs
 					logstate = LOGFILE_IDLE;
@@ -430,5 +596,5 @@ void Logging_Update(void)
 				}
 			} //EOF logfile error
 		}  // EOF CheckDelay
-	}// EOF Card in Slot
+	}// EOF Card mounted
 }
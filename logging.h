@@ -1,7 +1,10 @@
 #ifndef _LOGGING_H
 #define _LOGGING_H
 
+#include <inttypes.h>
+
 void Logging_Init(void);
 void Logging_Update(void); // logs the current gps position to a kml file
+void Logging_UBXData(uint8_t *pData, uint16_t len); // buffers raw gps data for the ubx file
 
 #endif //_LOGGING_H 
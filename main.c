@@ -16,9 +16,14 @@
 #include "button.h"
 #include "logging.h"
 #include "settings.h"
+#include "aid.h"
+#include "sched.h"
 
 #define FOLLOWME_INTERVAL 1000 // 1 second update
+#define FOLLOWME_TOLERANCE 1 // tolerance radius in m
+#define FOLLOWME_LATENCY 150 // expected time in ms until the position is used by the copter
 #define CELLUNDERVOLTAGE 32 // lowest allowed voltage/cell; 32 = 3.2V
+#define ADC_INTERVAL 10 // in ms, the filtered adc values are checked that often
 
 #ifdef USE_FOLLOWME
 int16_t UBat = 120;
@@ -31,10 +36,248 @@ int16_t delay = 0;
 uint16_t Error = 0;
 SysState_t SysState = STATE_UNDEFINED;
 
-int main (void)
+Timer_t FollowMe_Timer;
+uint16_t FollowMe_Time = 0; // time of the last follow me message
+
+//------------------------------------------------------------
+// called by the timer wheel if no new position is available (maybe bad gps signal condition)
+static void FollowMe_Blink(void)
+{
+	if(SysState == STATE_SEND_FOLLOWME) LEDGRN_TOGGLE;
+}
+
+//------------------------------------------------------------
+// send the follow me message if it is due
+void FollowMe_Update(void)
+{
+	if(FollowMe.Position.Status == NEWDATA)        // if new
+	{
+		// the interval depends on the motion of the target
+		if(!Request_SendFollowMe && GPS_FollowMeDue(CountMilliseconds - FollowMe_Time, FOLLOWME_TOLERANCE * 100))
+		{   // update remaining data
+			FollowMe_Time = CountMilliseconds;
+			FollowMe.Heading = 0;			// invalid heading
+			FollowMe.ToleranceRadius = FOLLOWME_TOLERANCE;
+			FollowMe.HoldTime = 60;         // go home after 60s without any update
+			FollowMe.Event_Flag = 0;        // no event
+			FollowMe.Index = 1;             // 2st wp
+			FollowMe.reserve[0] = 0;		// reserve
+			FollowMe.reserve[1] = 0;		// reserve
+			FollowMe.reserve[2] = 0;		// reserve
+			FollowMe.reserve[3] = 0;		// reserve
+			GPS_PredictPosition(&(FollowMe.Position), FOLLOWME_LATENCY); // compensate the age of the fix
+			GPS_FollowMeSent(&(FollowMe.Position));
+			Request_SendFollowMe = 1;       // triggers serial tranmission
+			if(!DebugOut.Analog[11]) DebugOut.Analog[11] = CountMilliseconds; // boot time until the first follow me
+			LEDGRN_TOGGLE;					// indication of active follow me
+		}
+		// blink on higher frequency if the next position does not arrive in time
+		Timer_Start(&FollowMe_Timer, FOLLOWME_INTERVAL/4, FOLLOWME_INTERVAL/4, FollowMe_Blink);
+	}
+}
+
+//------------------------------------------------------------
+// tasks of the main loop, see Tasks[] for their priorities
+
+// the data of the gps receiver, a new fix is sent at once as follow me message
+static uint8_t Task_GPSReady(void)
+{
+	return(fifo_used(&rxFifo) || (GPSData.Status == NEWDATA));
+}
+
+static void Task_GPS(void)
+{
+	UBX_Parser();
+	// configure the gps receiver after power on
+	UBX_Configure();
+	// get gps data to update the follow me position
+	GPS_Update();
+	if(SysState == STATE_SEND_FOLLOWME)
+	{
+		FollowMe_Update();
+		if(Request_SendFollowMe) USART0_TransmitTxData();
+	}
+	GPS_LatencyUpdate();
+}
+
+// call the callbacks of the expired timers
+static void Task_Timer(void)
+{
+	Timer_Update();
+}
+
+// serial communication
+static void Task_Serial(void)
+{
+	USART0_ProcessRxData();
+	USART0_TransmitTxData();
+}
+
+// button, system state and error indication
+static void Task_State(void)
+{
+	// check for button action and change state resectively
+	if(GetButton())
+	{
+		BeepTime = 200;
+
+		switch(SysState)
+		{
+			case STATE_IDLE:
+				if(!Error) SysState = STATE_SEND_FOLLOWME; // activate followme only of no error has occured
+				break;
+
+			case STATE_SEND_FOLLOWME:
+				SysState = STATE_IDLE;
+				break;
+
+			default:
+				SysState = STATE_IDLE;
+				break;
+		}
+
+	}
+
+	// state machine
+	DebugOut.Analog[9] = SysState;
+	switch(SysState)
+	{
+		case STATE_SEND_FOLLOWME:
+			// the follow me messages are sent right after the gps update
+			break;
+
+		case STATE_IDLE:
+			// do nothing
+			LEDGRN_ON;
+			break;
+
+		default:
+			// triger to idle state
+			SysState = STATE_IDLE;
+			break;
+
+	}
+
+	// indicate error, blinking code tbd.
+	if(Error)	LEDRED_ON;
+	else 		LEDRED_OFF;
+}
+
+// monitor the filtered adc values every ADC_INTERVAL
+static void Task_ADC(void)
+{
+	uint8_t ch;
+
+	if(!ADC_Valid) return; // the filters have not been started yet
+	for(ch = 0; ch < ADC_CHANNELS; ch++) DebugOut.Analog[ch] = ADC_GetValue(ch) >> 4;
+
+	#ifdef USE_FOLLOWME
+	// AVcc = 5V --> 5V = 1024 counts
+	// the voltage at the voltage divider reference point is 0.8V less that the UBat
+	// because of the silicon diode inbetween.
+	// voltage divider R2=10K, R3=3K9
+	// UAdc4 = R3/(R3+R2)*UBat= 3.9/(3.9+10)*UBat = UBat/3.564
+	// UBat = 64 * Adc4 / 368 with Adc4 in 1/16 LSB
+	UBat = ADC_GetValue(4) / 92;
+	DebugOut.Analog[8] = UBat;
+
+	// check for zellenzahl
+	if(PowerOn < 20)
+	{
+		if(UBat<=84) Zellenzahl = 2;
+		else Zellenzahl = 3;
+		PowerOn++;
+	}
+	DebugOut.Analog[16] = Zellenzahl;
+	DebugOut.Analog[17] = PowerOn;
+
+	//show recognised Zellenzahl to user
+	if(i < Zellenzahl && PowerOn >= 20 && BeepTime == 0 && delay > 150)
+	{
+		BeepTime = 100;
+		i++;
+		delay = 0;
+	}
+	if(delay < 200) delay++;
+
+	// monitor battery undervoltage [...||(UBat<74) as temporary workaround to protect 2s lipo packs]
+	if(((UBat < Zellenzahl * CELLUNDERVOLTAGE)||(UBat < 74)) && (PowerOn >= 20))
+	{   // sound for low battery
+		BeepModulation = 0x0300;
+		if(!BeepTime)
+		{
+			BeepTime = 6000; // 0.6 seconds
+		}
+		Error |= ERROR_LOW_BAT;
+	}
+	else
+	{
+		Error &= ~ERROR_LOW_BAT;
+	}
+	#endif
+}
+
+// check for card removal or insertion
+static void Task_Card(void)
+{
+	if(Fat16_Update()) // a card has been mounted
+	{
+		// read the settings from the card and restart logging with them
+		Settings_Init();
+		Logging_Init();
+	}
+}
+
+static void Task_Logging(void)
+{
+	// update logging
+	Logging_Update();
+	// aiding data of the gps receiver
+	Aid_Update();
+}
+
+// health of the gps receive path and other debug values
+static void Task_Debug(void)
+{
+	UBX_UpdateStat();
+	DebugOut.Analog[12] = UbxStat.RxRate;
+	DebugOut.Analog[13] = UbxStat.FifoOverflow;
+	DebugOut.Analog[14] = UbxStat.SyncLoss;
+	DebugOut.Analog[15] = UbxStat.ChecksumError[UBX_STAT_SOL] + UbxStat.ChecksumError[UBX_STAT_POSLLH] + UbxStat.ChecksumError[UBX_STAT_VELNED] + UbxStat.ChecksumError[UBX_STAT_PVT];
+	DebugOut.Analog[18] = UbxStat.EpochRate;
+	DebugOut.Analog[19] = UbxStat.EpochInterval;
+	DebugOut.Analog[20] = UbxStat.EpochJitter;
+	DebugOut.Analog[21] = UbxStat.EpochIncomplete;
+	DebugOut.Analog[22] = UbxStat.FifoHighwater;
+	DebugOut.Analog[23] = GPS_Tracker.Lat.Innovation;
+	DebugOut.Analog[24] = GPS_Tracker.Lon.Innovation;
+	DebugOut.Analog[25] = GPS_FollowMeInterval;
+	DebugOut.Analog[26] = Aid_TTFF;
+	DebugOut.Analog[27] = Aid_Frames;
+	DebugOut.Analog[28] = SchedStat.Wakeups;
+	DebugOut.Analog[29] = SchedStat.Load;
+	DebugOut.Analog[30] = SchedStat.Current;
+	DebugOut.Analog[31] = UART_RxStat.Dropped;
+}
+
+// the tasks in the order of their priority
+Task_t Tasks[] =
 {
-	static uint16_t FollowMe_Timer = 0;
+  //{pTask        , pReady        , Period, Deadline}
+	{Task_GPS     , Task_GPSReady ,     10,        5},
+	{Task_Timer   , NULL          ,      1,       10},
+	{Task_Serial  , NULL          ,      2,       20},
+	{Task_State   , NULL          ,     10,       50},
+	{Task_ADC     , NULL          , ADC_INTERVAL,  50},
+	{Task_Card    , NULL          ,     10,      100},
+	{Task_Logging , NULL          ,     10,      200},
+	{Task_Debug   , NULL          ,    100,      200}
+};
+
+#define TASK_COUNT	(sizeof(Tasks) / sizeof(Task_t))
 
+int main (void)
+{
 	// disable interrupts global
 	//cli();
 
@@ -55,9 +298,8 @@ int main (void)
 	// enable interrupts global
 	sei();
 
-	// try to initialize the FAT 16 filesystem on the SD-Card
-	Fat16_Init();
-	// initialize the settings
+	// the FAT 16 filesystem on the SD-Card is mounted in the background by Fat16_Update(),
+	// start with the default settings until the settings file has been read from the card
 	Settings_Init();
 	// initialize logging (needs settings)
 	Logging_Init();
@@ -80,149 +322,14 @@ int main (void)
 
     Menu_Clear();
 
-	FollowMe_Timer = SetDelay(FOLLOWME_INTERVAL);
+	Timer_Start(&FollowMe_Timer, FOLLOWME_INTERVAL, FOLLOWME_INTERVAL/4, FollowMe_Blink);
+	DebugOut.Analog[10] = CountMilliseconds; // boot time until the main loop is running
 
+	Sched_Init(Tasks, TASK_COUNT);
 	while (1)
-	{UBX_Parser();
-		// get gps data to update the follow me position
-		GPS_Update();
-
-		// update logging
-		Logging_Update();
-
-		// check for button action and change state resectively
-		if(GetButton())
-		{
-			BeepTime = 200;
-
-			switch(SysState)
-			{
-				case STATE_IDLE:
-					if(!Error) SysState = STATE_SEND_FOLLOWME; // activate followme only of no error has occured
-					break;
-
-				case STATE_SEND_FOLLOWME:
-					SysState = STATE_IDLE;
-					break;
-
-				default:
-					SysState = STATE_IDLE;
-					break;
-			}
-
-		}
-
-		// state machine
-		DebugOut.Analog[9] = SysState;
-		switch(SysState)
-		{
-			case STATE_SEND_FOLLOWME:
-				if(CheckDelay(FollowMe_Timer)) // time for next message?
-				{
-					if(FollowMe.Position.Status == NEWDATA)        // if new
-					{   // update remaining data
-						FollowMe_Timer = SetDelay(FOLLOWME_INTERVAL);  // reset timer
-						FollowMe.Heading = 0;			// invalid heading
-						FollowMe.ToleranceRadius = 1;   // 1 meter
-						FollowMe.HoldTime = 60;         // go home after 60s without any update
-						FollowMe.Event_Flag = 0;        // no event
-						FollowMe.Index = 1;             // 2st wp
-						FollowMe.reserve[0] = 0;		// reserve
-						FollowMe.reserve[1] = 0;		// reserve
-						FollowMe.reserve[2] = 0;		// reserve
-						FollowMe.reserve[3] = 0;		// reserve
-						Request_SendFollowMe = 1;       // triggers serial tranmission
-
-					}
-					else // now new position avalable (maybe bad gps signal condition)
-					{
-						FollowMe_Timer = SetDelay(FOLLOWME_INTERVAL/4);  // reset timer on higer frequency
-					}
-					LEDGRN_TOGGLE;						// indication of active follow me
-				}
-				break;
-
-			case STATE_IDLE:
-				// do nothing
-				LEDGRN_ON;
-				break;
-
-			default:
-				// triger to idle state
-				SysState = STATE_IDLE;
-				break;
-
-		}
-
-
-		// restart ADConversion if ready
-		if(ADReady)
-		{
-			DebugOut.Analog[0] = Adc0;
-			DebugOut.Analog[1] = Adc1;
-			DebugOut.Analog[2] = Adc2;
-			DebugOut.Analog[3] = Adc3;
-			DebugOut.Analog[4] = Adc4;
-			DebugOut.Analog[5] = Adc5;
-			DebugOut.Analog[6] = Adc6;
-			DebugOut.Analog[7] = Adc7;
-
-			#ifdef USE_FOLLOWME
-			// AVcc = 5V --> 5V = 1024 counts
-			// the voltage at the voltage divider reference point is 0.8V less that the UBat
-			// because of the silicon diode inbetween.
-			// voltage divider R2=10K, R3=3K9
-			// UAdc4 = R3/(R3+R2)*UBat= 3.9/(3.9+10)*UBat = UBat/3.564
-			UBat = (3 * UBat + (64 * Adc4) / 368) / 4;
-			DebugOut.Analog[8] = UBat;
-
-			// check for zellenzahl
-			if(PowerOn < 100)
-			{
-				if(UBat<=84) Zellenzahl = 2;
-				else Zellenzahl = 3;
-				PowerOn++;
-			}
-			DebugOut.Analog[16] = Zellenzahl;
-			DebugOut.Analog[17] = PowerOn;
-
-			//show recognised Zellenzahl to user
-			if(i < Zellenzahl && PowerOn >= 100 && BeepTime == 0 && delay > 1000)
-			{
-				BeepTime = 100;
-				i++;
-				delay = 0;
-			}
-			if(delay < 1500) delay++;
-
-			// monitor battery undervoltage [...||(UBat<74) as temporary workaround to protect 2s lipo packs]
-			if(((UBat < Zellenzahl * CELLUNDERVOLTAGE)||(UBat < 74)) && (PowerOn >= 100))
-			{   // sound for low battery
-				BeepModulation = 0x0300;
-				if(!BeepTime)
-				{
-					BeepTime = 6000; // 0.6 seconds
-				}
-				Error |= ERROR_LOW_BAT;
-			}
-			else
-			{
-				Error &= ~ERROR_LOW_BAT;
-			}
-			#endif
-			ADReady = 0;
-			ADC_Enable(); // restart ad conversion sequence
-		}
-
-		// serial communication
-		USART0_ProcessRxData();
-		USART0_TransmitTxData();
-
-		// indicate error, blinking code tbd.
-		if(Error)	LEDRED_ON;
-		else 		LEDRED_OFF;
-
-    }
+	{
+		if(!Sched_Run()) Sched_Idle(); // sleep until the next interrupt if no task is due
+	}
  	return (1);
 }
 
@@ -0,0 +1,135 @@
+#include <inttypes.h>
+#include <stddef.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "sched.h"
+#include "timer0.h"
+
+// typical supply current of the cpu at 8 MHz and 5 V in 0.1 mA
+#define SCHED_CURRENT_ACTIVE	100
+#define SCHED_CURRENT_IDLE		30
+
+TaskStat_t TaskStat[SCHED_MAX_TASKS];
+SchedStat_t SchedStat = {0, 0, 0};
+
+Task_t *Sched_Tasks = NULL;
+uint8_t Sched_Count = 0;
+uint32_t Sched_AvgTime[SCHED_MAX_TASKS];	// average execution time in us * 8
+uint32_t Sched_BusyTime = 0;				// execution time of all tasks within the current second in us
+uint16_t Sched_Wakeups = 0;					// wakeups within the current second
+Timer_t Sched_StatTimer;
+
+// called every second by the timer wheel
+static void Sched_UpdateStat(void)
+{
+	uint32_t busy = Sched_BusyTime;
+
+	if(busy > 1000000L) busy = 1000000L;
+	SchedStat.Wakeups = Sched_Wakeups;
+	SchedStat.Load = (uint8_t)(busy / 10000L);
+	SchedStat.Current = SCHED_CURRENT_IDLE + (uint16_t)(((SCHED_CURRENT_ACTIVE - SCHED_CURRENT_IDLE) * (busy / 1000L)) / 1000L);
+	Sched_BusyTime = 0;
+	Sched_Wakeups = 0;
+}
+
+/********************************************************/
+/*          Initialize the scheduler                    */
+/********************************************************/
+void Sched_Init(Task_t *pTasks, uint8_t count)
+{
+	uint8_t i;
+
+	if(count > SCHED_MAX_TASKS) count = SCHED_MAX_TASKS;
+	for(i = 0; i < count; i++)
+	{
+		pTasks[i].Due = SetDelay(pTasks[i].Period);
+		TaskStat[i].Runs = 0;
+		TaskStat[i].AvgTime = 0;
+		TaskStat[i].MaxTime = 0;
+		TaskStat[i].Misses = 0;
+		Sched_AvgTime[i] = 0;
+	}
+	Sched_Tasks = pTasks;
+	Sched_Count = count;
+	Timer_Start(&Sched_StatTimer, 1000, 1000, Sched_UpdateStat);
+}
+
+/********************************************************/
+/*     Run the task with the highest priority that is due */
+/********************************************************/
+// Has to be called from the main loop. Only one task is run per call, therefore the tasks
+// with a higher priority are checked again between two slices of a task with a lower priority.
+uint8_t Sched_Run(void)
+{
+	Task_t *pTask;
+	TaskStat_t *pStat;
+	uint16_t late;
+	uint32_t start, time;
+	uint8_t i, periodic;
+
+	for(i = 0; i < Sched_Count; i++)
+	{
+		pTask = &Sched_Tasks[i];
+		periodic = pTask->Period && CheckDelay(pTask->Due);
+		if(!periodic && !((pTask->pReady != NULL) && pTask->pReady())) continue;
+
+		pStat = &TaskStat[i];
+		if(periodic)
+		{
+			late = CountMilliseconds - pTask->Due;
+			if(late > pTask->Deadline) pStat->Misses++;
+			pTask->Due += pTask->Period;
+			if(CheckDelay(pTask->Due)) pTask->Due = SetDelay(pTask->Period); // skip the missed periods
+		}
+		start = GetMicroseconds();
+		pTask->pTask();
+		time = GetMicroseconds() - start;
+		Sched_BusyTime += time;
+		if(time > 0xFFFF) time = 0xFFFF;
+		pStat->Runs++;
+		if(time > pStat->MaxTime) pStat->MaxTime = (uint16_t)time;
+		Sched_AvgTime[i] += time - (Sched_AvgTime[i] >> 3);
+		pStat->AvgTime = (uint16_t)(Sched_AvgTime[i] >> 3);
+		return(1);
+	}
+	return(0);
+}
+
+// returns 1 if a task is due, called with the interrupts disabled
+static uint8_t Sched_Pending(void)
+{
+	Task_t *pTask;
+	uint8_t i;
+
+	for(i = 0; i < Sched_Count; i++)
+	{
+		pTask = &Sched_Tasks[i];
+		if(pTask->Period && CheckDelay(pTask->Due)) return(1);
+		if((pTask->pReady != NULL) && pTask->pReady()) return(1);
+	}
+	return(0);
+}
+
+/********************************************************/
+/*          Sleep until the next interrupt              */
+/********************************************************/
+// The cpu is woken up by any interrupt, i.e. the ms tick of timer 0, the uarts or the spi.
+// The tasks are checked again with the interrupts disabled, so the work of an interrupt after the last
+// check of Sched_Run() does not wait for the next interrupt. The instruction following sei() is always
+// executed before a pending interrupt is served, therefore an interrupt after the check wakes up the cpu at once.
+void Sched_Idle(void)
+{
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	if(Sched_Pending())
+	{
+		sei();
+		return;
+	}
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+	Sched_Wakeups++;
+}
@@ -0,0 +1,45 @@
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include <inttypes.h>
+
+#define SCHED_MAX_TASKS		8
+
+// a task of the cooperative scheduler, the priority is given by the position in the task table
+typedef struct
+{
+	void		(*pTask)(void);		// has to return after a short slice of work
+	uint8_t		(*pReady)(void);	// returns 1 if the task has work pending, NULL = periodic only, must not enable the interrupts
+	uint16_t	Period;				// in ms, the task is run at least that often, 0 = by pReady only
+	uint16_t	Deadline;			// in ms, max. delay of a periodic run
+	uint16_t	Due;				// time of the next periodic run
+} Task_t;
+
+// the statistics of a task
+typedef struct
+{
+	uint32_t	Runs;				// number of runs
+	uint16_t	AvgTime;			// average execution time in us
+	uint16_t	MaxTime;			// worst case execution time in us
+	uint16_t	Misses;				// number of periodic runs later than the deadline
+} __attribute__((packed)) TaskStat_t;
+
+extern TaskStat_t TaskStat[SCHED_MAX_TASKS];
+
+// the load of the cpu within the last second
+typedef struct
+{
+	uint16_t	Wakeups;			// number of wakeups from the idle sleep
+	uint8_t		Load;				// time the tasks were running in %
+	uint16_t	Current;			// estimated supply current of the cpu in 0.1 mA
+} __attribute__((packed)) SchedStat_t;
+
+extern SchedStat_t SchedStat;
+
+void Sched_Init(Task_t *pTasks, uint8_t count);
+// runs the task with the highest priority that is due, returns 0 if no task was due
+uint8_t Sched_Run(void);
+// sleeps until the next interrupt, has to be called if no task is due
+void Sched_Idle(void);
+
+#endif //_SCHED_H
@@ -8,6 +8,7 @@
 #include "crc16.h"
 
 //#define _SD_DEBUG
+#define _SD_CRC		// enable the crc check of the sd-card, comment out to run with crc check disabled (CMD59) on trusted links
 
 #define CMD_GO_IDLE_STATE		0x00	/* CMD00: response R1 */
 #define CMD_SEND_OP_COND		0x01 	/* CMD01: response R1 */
@@ -68,6 +69,19 @@ typedef struct
 
 volatile SDCardInfo_t SDCardInfo;
 
+// states of the card initialisation
+typedef enum
+{
+	SDC_INIT_DONE,
+	SDC_INIT_IDLE_STATE,
+	SDC_INIT_IF_COND,
+	SDC_INIT_OP_COND,
+	SDC_INIT_CARD_INFO
+} SDInitState_t;
+
+SDInitState_t SDInitState = SDC_INIT_DONE;
+uint16_t SDInitTimeout = 0;
+
 //________________________________________________________________________________________________________________________________________
 // Function: 	CRC7(uint8_t* cmd, uint32_t len);
 //
@@ -292,20 +306,19 @@ SD_Result_t SDC_GetCSD(uint8_t * pCSD)
 
 
 //________________________________________________________________________________________________________________________________________
-// Function: 	SDC_Init(void);
-//
-// Description:	This function initialises the SDCard to spi-mode.
+// Function: 	SDC_InitStart(void);
 //
+// Description:	This function starts the initialisation of the SDCard to spi-mode. The initialisation has to be continued
+//				by calling SDC_InitStep() until it does not return SD_PENDING anymore.
 //
-// Returnvalue: the function returns 0 if the initialisation was successfull otherwise the function returns an errorcode.
+// Returnvalue: the function returns SD_PENDING if the initialisation was started otherwise the function returns an errorcode.
 //________________________________________________________________________________________________________________________________________
 
-SD_Result_t SDC_Init(void)
+SD_Result_t SDC_InitStart(void)
 {
-	uint16_t timeout = 0;
-	uint8_t rsp[6]; // SD-SPI response buffer
-	SD_Result_t result = SD_ERROR_UNKNOWN;
+	uint8_t i;
 
+	SDCardInfo.Valid = 0;
 	if(SD_SWITCH) // init only if the SD-Switch is indicating a card in the slot
 	{
 		printf("\r\n SSC init...");
@@ -315,231 +328,307 @@ SD_Result_t SDC_Init(void)
 		//_delay_loop_2(1050);
 
 		printf("\r\n SDC init...");
-		SDCardInfo.Valid = 0;
 		/* The host shall supply power to the card so that the voltage is reached to Vdd_min within 250ms and
 		start to supply at least 74 SD clocks to the SD card with keeping cmd line to high. In case of SPI
 		mode, CS shall be held to high during 74 clock cycles. */
 		SSC_Disable(); // set SD_CS high
-		for (timeout = 0; timeout < 15; timeout++) 	// 15*8 = 120 cycles
+		for (i = 0; i < 15; i++) 	// 15*8 = 120 cycles
 		{
 			SSC_PutChar(0xFF);
 		}
-
 		// switch to idle state
 		#ifdef _SD_DEBUG
 		printf("\r\nGoing idle state..");
 		#endif
-		timeout = 0;
-		do
-		{
+		SDInitTimeout = 0;
+		SDInitState = SDC_INIT_IDLE_STATE;
+		return(SD_PENDING);
+	}
+	else
+	{
+		SSC_Deinit();
+		SDInitState = SDC_INIT_DONE;
+		printf("No Card in Slot.");
+		return(SD_ERROR_NOCARD);
+	}
+}
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	SDC_ReadCardInfo(void);
+//
+// Description:	This function sets the block length and reads the CID and CSD register of an initialized SDCard.
+//
+//
+// Returnvalue: the function returns SD_SUCCESS if the card info could be read otherwise the function returns an errorcode.
+//________________________________________________________________________________________________________________________________________
+
+SD_Result_t SDC_ReadCardInfo(void)
+{
+	SD_Result_t result = SD_ERROR_UNKNOWN;
+	uint8_t c_size_mult, read_bl_len;
+	uint32_t c_size;
+
+	/* set block size to 512 bytes */
+	if(SDC_SendCMDR1(CMD_SET_BLOCKLEN, 512UL) != R1_NO_ERR)
+	{
+		printf("Error setting block length to 512.");
+		return(SD_ERROR_SET_BLOCKLEN);
+	}
+
+	//SSC_Disable(); // set SD_CS high
+	// here is the right place to inrease the SPI baud rate to maximum
+	//SSC_Enable(); // set SD_CS high
+
+	// read CID register
+	result = SDC_GetCID((uint8_t *)&SDCardInfo.CID);
+	if(result != SD_SUCCESS)
+	{
+		printf("Error reading CID.\r\n");
+		return(result);
+	}
+
+	// read CSD register
+	result = SDC_GetCSD((uint8_t *)&SDCardInfo.CSD);
+	if(result != SD_SUCCESS)
+	{
+		printf("Error reading CSD.");
+		return(result);
+	}
+
+	printf("ok\r\n");
+
+	switch(SDCardInfo.CSD[0]>>6) // check CSD Version
+	{
+	case 0x00: // if CSD is V1.0 structure (2GB limit)
+
+		/*
+		memory capacity = BLOCKNR * BLOCK_LEN
+		BLOCKNR = (C_SIZE+1) * MULT
+		MULT = 2^(C_SIZE_MULT+2)
+		BLOCK_LEN = 2^READ_BL_LEN
+
+		C_SIZE      is 12 bits [73:62] in CSD register
+		C_SIZE_MULT is  3 bits [49:47] in CSD register
+		READ_BL_LEN is  4 bits [83:80] in CSD register
+		*/
+
+		read_bl_len = (SDCardInfo.CSD[5] & 0x0F); 				//CSD[05] -> [87:80]
+		c_size = ((uint32_t)(SDCardInfo.CSD[6] & 0x03))<<10; 	//CSD[06] -> [79:72]
+		c_size |= ((uint32_t)SDCardInfo.CSD[7])<<2;				//CSD[07] -> [71:64]
+		c_size |= (uint32_t)(SDCardInfo.CSD[8]>>6);				//CSD[08] -> [63:56]
+		c_size_mult = (SDCardInfo.CSD[9] & 0x03)<<1;  			//CSD[09] -> [55:48]
+		c_size_mult |=(SDCardInfo.CSD[10] & 0x80)>>7;			//CSD[10] -> [47:40]
+		SDCardInfo.Capacity = (uint32_t)(c_size+1)*(1L<<(c_size_mult+2))*(1L<<read_bl_len);
+		break;
+
+	case 0x01: // if CSD is V2.0 structure (HC SD-Card > 2GB)
+
+		/*
+		memory capacity = (C_SIZE+1) * 512K byte
+		C_SIZE is 22 bits [69:48] in CSR register
+		*/
+
+		c_size = ((uint32_t)(SDCardInfo.CSD[7] & 0x3F))<<16;	//CSD[07] -> [71:64]
+		c_size |= ((uint32_t)SDCardInfo.CSD[8])<<8;				//CSD[08] -> [63:56]
+		c_size |= (uint32_t)SDCardInfo.CSD[9];  				//CSD[09] -> [55:48];
+	 	SDCardInfo.Capacity = (c_size + 1)* 512L * 1024L;
+		break;
+
+	default: //unknown CSD Version
+		SDCardInfo.Capacity = 0;
+		break;
+	}
+
+	switch(SDCardInfo.Version)
+	{
+	 	case VER_1X:
+			printf("\r\n  SD-CARD V1.x");
+			break;
+	   	case VER_20:
+			printf("\r\n  SD-CARD V2.0 or later");
+	 	default:
+	 		break;
+	}
+	uint16_t mb_size = (uint16_t)(SDCardInfo.Capacity/(1024L*1024L));
+	printf("\r\n  Capacity = %i MB", mb_size);
+
+	SDC_PrintCID((uint8_t *)&SDCardInfo.CID);
+	SDCardInfo.Valid = 1;
+	return(SD_SUCCESS);
+}
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	SDC_InitStep(void);
+//
+// Description:	This function continues the initialisation started by SDC_InitStart(). Every call sends only one command
+//				sequence to the SDCard, so the caller is not blocked while the card is initializing (this takes up to 2s).
+//
+// Returnvalue: the function returns SD_PENDING while the initialisation is in progress, SD_SUCCESS if the
+//				initialisation was successfull otherwise the function returns an errorcode.
+//________________________________________________________________________________________________________________________________________
+
+SD_Result_t SDC_InitStep(void)
+{
+	uint8_t i;
+	uint8_t rsp[6]; // SD-SPI response buffer
+	SD_Result_t result = SD_PENDING;
+
+	switch(SDInitState)
+	{
+		case SDC_INIT_IDLE_STATE:
 			rsp[0] = SDC_SendCMDR1(CMD_GO_IDLE_STATE, 0UL);
-			if (timeout++ > 500)
+			if(rsp[0] == R1_IDLE_STATE)
+			{
+				SDInitState = SDC_INIT_IF_COND;
+			}
+			else if (SDInitTimeout++ > 500)
 			{
 				printf("reset timeout");
 				result = SD_ERROR_RESET;
-				goto end;
 			}
-		}while(rsp[0] != R1_IDLE_STATE);
-	    // enable crc feature
-/*		if(SDC_SendCMDR1(CMD_CRC_ON_OFF, 1UL) != R1_IDLE_STATE)
-		{
+			break;
+
+		case SDC_INIT_IF_COND:
+			#ifdef _SD_CRC
+		    // enable crc feature
+			rsp[0] = SDC_SendCMDR1(CMD_CRC_ON_OFF, 1UL);
+			if(rsp[0] != R1_IDLE_STATE)
+			{
 				printf("Bad cmd59 R1=%02X.", rsp[0]);
 				result = SD_ERROR_BAD_RESPONSE;
-				goto end;
-		}*/
-		// check for card hw version
-		// 2.7-3.6V Range = 0x01, check pattern 0xAA
-		rsp[0] = SDC_SendCMDR1(CMD_SEND_IF_COND, 0x000001AA);
-		// answer to cmd58 is an R7 response (R1+ 4Byte IFCond)
-		if(rsp[0] & R1_BAD_RESPONSE)
-		{
-			printf("Bad cmd8 R1=%02X.", rsp[0]);
-			result = SD_ERROR_BAD_RESPONSE;
-			goto end;
-		}
-		if(rsp[0] & R1_ILLEGAL_CMD)
-		{
-			//Ver1.X SD Memory Card or not a SD Memory Card
-			SDCardInfo.Version = VER_1X;
-		}
-		else
-		{
-		   // Ver2.00 or later SD Memory Card
-		   // reading the remaining bytes of the R7 response
-		   SDCardInfo.Version = VER_20;
-		   for(timeout = 1; timeout < 5; timeout++)
-		   {
-				rsp[timeout] = SSC_GetChar();
-		   }
-		   //check pattern
-		   if(rsp[4]!= 0xAA)
-		   {
-			 	printf("Bad cmd8 R7 check pattern.\r\n");
+				break;
+			}
+			#endif
+			// check for card hw version
+			// 2.7-3.6V Range = 0x01, check pattern 0xAA
+			rsp[0] = SDC_SendCMDR1(CMD_SEND_IF_COND, 0x000001AA);
+			// answer to cmd58 is an R7 response (R1+ 4Byte IFCond)
+			if(rsp[0] & R1_BAD_RESPONSE)
+			{
+				printf("Bad cmd8 R1=%02X.", rsp[0]);
 				result = SD_ERROR_BAD_RESPONSE;
-				goto end;
-		   }
-		   if ( (rsp[3] & 0x0F)!= 0x01 ) // voltage range is not 2.7-3.6V
-		   {
+				break;
+			}
+			if(rsp[0] & R1_ILLEGAL_CMD)
+			{
+				//Ver1.X SD Memory Card or not a SD Memory Card
+				SDCardInfo.Version = VER_1X;
+			}
+			else
+			{
+			   // Ver2.00 or later SD Memory Card
+			   // reading the remaining bytes of the R7 response
+			   SDCardInfo.Version = VER_20;
+			   for(i = 1; i < 5; i++)
+			   {
+					rsp[i] = SSC_GetChar();
+			   }
+			   //check pattern
+			   if(rsp[4]!= 0xAA)
+			   {
+				 	printf("Bad cmd8 R7 check pattern.\r\n");
+					result = SD_ERROR_BAD_RESPONSE;
+					break;
+			   }
+			   if ( (rsp[3] & 0x0F)!= 0x01 ) // voltage range is not 2.7-3.6V
+			   {
+
+			   		printf("Card is incompatible to 3.3V.\r\n");
+					result = SD_ERROR_BAD_VOLTAGE_RANGE;
+					break;
+			   }
+			}
 
-		   		printf("Card is incompatible to 3.3V.\r\n");
+			rsp[0] = SDC_SendCMDR1(CMD_READ_OCR, 0UL);
+			// answer to cmd58 is an R3 response (R1 + 4Byte OCR)
+			if(rsp[0] & R1_BAD_RESPONSE)
+			{
+				printf("Bad cmd58 R1 %02x.", rsp[0]);
+				result = SD_ERROR_BAD_RESPONSE;
+				break;
+			}
+			if(rsp[0] & R1_ILLEGAL_CMD)
+			{
+				printf("Not an SD-CARD.");
+				result = SD_ERROR_NO_SDCARD;
+				break;
+			}
+			// read 4 bytes of OCR register
+			for(i = 1; i < 5; i++)
+			{
+				rsp[i] = SSC_GetChar();
+			}
+			//	FollowMe & SD-Logger uses 3.3 V,  therefore check for bit 20 & 21
+			if((rsp[2] & 0x30) != 0x30)
+			{
+			 	// supply voltage is not supported by sd-card
+				printf("Card is incompatible to 3.3V.");
 				result = SD_ERROR_BAD_VOLTAGE_RANGE;
-				goto end;
-		   }
-		}
-
-		rsp[0] = SDC_SendCMDR1(CMD_READ_OCR, 0UL);
-		// answer to cmd58 is an R3 response (R1 + 4Byte OCR)
-		if(rsp[0] & R1_BAD_RESPONSE)
-		{
-			printf("Bad cmd58 R1 %02x.", rsp[0]);
-			result = SD_ERROR_BAD_RESPONSE;
-			goto end;
-		}
-		if(rsp[0] & R1_ILLEGAL_CMD)
-		{
-			printf("Not an SD-CARD.");
-			result = SD_ERROR_NO_SDCARD;
-			goto end;
-		}
-		// read 4 bytes of OCR register
-		for(timeout = 1; timeout < 5; timeout++)
-		{
-			rsp[timeout] = SSC_GetChar();
-		}
-		//	FollowMe & SD-Logger uses 3.3 V,  therefore check for bit 20 & 21
-		if((rsp[2] & 0x30) != 0x30)
-		{
-		 	// supply voltage is not supported by sd-card
-			printf("Card is incompatible to 3.3V.");
-			result = SD_ERROR_BAD_VOLTAGE_RANGE;
-			goto end;
-		}
+				break;
+			}
+			// Initialize the sd-card sending continously ACMD_SEND_OP_COND (only supported by SD cards)
+			SDInitTimeout =  SetDelay(2000); // set timeout to 2000 ms (large cards tend to longer)
+			SDInitState = SDC_INIT_OP_COND;
+			break;
 
-		// Initialize the sd-card sending continously ACMD_SEND_OP_COND (only supported by SD cards)
-		timeout =  SetDelay(2000); // set timeout to 2000 ms (large cards tend to longer)
-		do
-		{
+		case SDC_INIT_OP_COND:
 			rsp[0] = SDC_SendACMDR1(ACMD_SEND_OP_COND, 0UL);
 			if(rsp[0] & R1_BAD_RESPONSE)
 			{
 				printf("Bad Acmd41 R1=%02X.", rsp[0]);
 				result = SD_ERROR_BAD_RESPONSE;
-				goto end;
 			}
-			if(CheckDelay(timeout))
+			else if(!(rsp[0] & R1_IDLE_STATE)) // card has left the idle state
+			{
+				if(rsp[0] != R1_NO_ERR)
+				{
+					printf("Init error.");
+				 	result = SD_ERROR_INITIALIZE;
+				}
+				else SDInitState = SDC_INIT_CARD_INFO;
+			}
+			else if(CheckDelay(SDInitTimeout))
 			{
 			    printf("Init timeout.");
 				result = SD_ERROR_INITIALIZE;
-				goto end;
 			}
-		} while(rsp[0] & R1_IDLE_STATE); // loop until idle state
-
-		if(rsp[0] != R1_NO_ERR)
-		{
-			printf("Init error.");
-		 	result = SD_ERROR_INITIALIZE;
-			goto end;
-		}
-		/* set block size to 512 bytes */
-    	if(SDC_SendCMDR1(CMD_SET_BLOCKLEN, 512UL) != R1_NO_ERR)
-    	{
-        	printf("Error setting block length to 512.");
-		 	result = SD_ERROR_SET_BLOCKLEN;
-			goto end;
-    	}
-
-		//SSC_Disable(); // set SD_CS high
-		// here is the right place to inrease the SPI baud rate to maximum
-		//SSC_Enable(); // set SD_CS high
-
-		// read CID register
-		result = SDC_GetCID((uint8_t *)&SDCardInfo.CID);
-		if(result != SD_SUCCESS)
-		{
-			printf("Error reading CID.\r\n");
-			goto end;
-		}
-
-		// read CSD register
-		result = SDC_GetCSD((uint8_t *)&SDCardInfo.CSD);
-		if(result != SD_SUCCESS)
-		{
-			printf("Error reading CSD.");
-			goto end;
-		}
-
-		printf("ok\r\n");
-
-		uint8_t c_size_mult, read_bl_len;
-		uint32_t c_size;
-
-		switch(SDCardInfo.CSD[0]>>6) // check CSD Version
-		{
-		case 0x00: // if CSD is V1.0 structure (2GB limit)
-
-			/*
-			memory capacity = BLOCKNR * BLOCK_LEN
-			BLOCKNR = (C_SIZE+1) * MULT
-			MULT = 2^(C_SIZE_MULT+2)
-			BLOCK_LEN = 2^READ_BL_LEN
-
-			C_SIZE      is 12 bits [73:62] in CSD register
-			C_SIZE_MULT is  3 bits [49:47] in CSD register
-			READ_BL_LEN is  4 bits [83:80] in CSD register
-			*/
-
-			read_bl_len = (SDCardInfo.CSD[5] & 0x0F); 				//CSD[05] -> [87:80]
-			c_size = ((uint32_t)(SDCardInfo.CSD[6] & 0x03))<<10; 	//CSD[06] -> [79:72]
-			c_size |= ((uint32_t)SDCardInfo.CSD[7])<<2;				//CSD[07] -> [71:64]
-			c_size |= (uint32_t)(SDCardInfo.CSD[8]>>6);				//CSD[08] -> [63:56]
-			c_size_mult = (SDCardInfo.CSD[9] & 0x03)<<1;  			//CSD[09] -> [55:48]
-			c_size_mult |=(SDCardInfo.CSD[10] & 0x80)>>7;			//CSD[10] -> [47:40]
-			SDCardInfo.Capacity = (uint32_t)(c_size+1)*(1L<<(c_size_mult+2))*(1L<<read_bl_len);
 			break;
 
-		case 0x01: // if CSD is V2.0 structure (HC SD-Card > 2GB)
-
-			/*
-			memory capacity = (C_SIZE+1) * 512K byte
-			C_SIZE is 22 bits [69:48] in CSR register
-			*/
-
-			c_size = ((uint32_t)(SDCardInfo.CSD[7] & 0x3F))<<16;	//CSD[07] -> [71:64]
-			c_size |= ((uint32_t)SDCardInfo.CSD[8])<<8;				//CSD[08] -> [63:56]
-			c_size |= (uint32_t)SDCardInfo.CSD[9];  				//CSD[09] -> [55:48];
-		 	SDCardInfo.Capacity = (c_size + 1)* 512L * 1024L;
+		case SDC_INIT_CARD_INFO:
+			result = SDC_ReadCardInfo();
 			break;
 
-		default: //unknown CSD Version
-			SDCardInfo.Capacity = 0;
+		default: // no initialisation in progress
+			if(SDCardInfo.Valid) result = SD_SUCCESS;
+			else result = SD_ERROR_INITIALIZE;
 			break;
-		}
-
-		switch(SDCardInfo.Version)
-		{
-		 	case VER_1X:
-				printf("\r\n  SD-CARD V1.x");
-				break;
-		   	case VER_20:
-				printf("\r\n  SD-CARD V2.0 or later");
-		 	default:
-		 		break;
-		}
-		uint16_t mb_size = (uint16_t)(SDCardInfo.Capacity/(1024L*1024L));
-		printf("\r\n  Capacity = %i MB", mb_size);
-
-		SDC_PrintCID((uint8_t *)&SDCardInfo.CID);
-		SDCardInfo.Valid = 1;
-		// jump point for error	condition before
-		end:
+	}
+	// initialisation is finished
+	if(result != SD_PENDING)
+	{
+		SDInitState = SDC_INIT_DONE;
 		SSC_Disable();
 	}
-	else
+	return(result);
+}
+
+//________________________________________________________________________________________________________________________________________
+// Function: 	SDC_Init(void);
+//
+// Description:	This function initialises the SDCard to spi-mode and blocks until the initialisation is finished.
+//
+//
+// Returnvalue: the function returns 0 if the initialisation was successfull otherwise the function returns an errorcode.
+//________________________________________________________________________________________________________________________________________
+
+SD_Result_t SDC_Init(void)
+{
+	SD_Result_t result;
+
+	result = SDC_InitStart();
+	while(result == SD_PENDING)
 	{
-		SSC_Deinit();
-		SDCardInfo.Valid = 0;
-		result = SD_ERROR_NOCARD;
-		printf("No Card in Slot.");
+		result = SDC_InitStep();
 	}
 	return(result);
 }
@@ -595,13 +684,15 @@ SD_Result_t SDC_PutSector(uint32_t addr, const uint8_t *Buffer)
 	{
 		SSC_GetChar();
 	}
-	crc16 = CRC16(Buffer, 512);         // calc checksum for data block
 	SSC_PutChar(DATA_START_TOKEN);		// send data start of header to the SSC
-
-	for (a=0;a<512;a++)					// transmit one sector (normaly 512bytes) of data to the sdcard.
-	{
-		SSC_PutChar(Buffer[a]);
-	}
+	// transmit one sector (normaly 512bytes) of data to the sdcard.
+	#ifdef _SD_CRC
+	crc16 = 0;
+	SSC_PutBlock(Buffer, 512, &crc16);	// the checksum is calculated while the spi is shifting out the data
+	#else
+	crc16 = 0xFFFF;						// the checksum is ignored by the sdcard
+	SSC_PutBlock(Buffer, 512, 0);
+	#endif
 	// write two bytes of crc16 to the sdcard
 	SSC_PutChar((uint8_t)(crc16>>8)); 		// write high byte first
 	SSC_PutChar((uint8_t)(0x00FF&crc16)); 	// lowbyte last
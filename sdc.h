@@ -17,10 +17,13 @@ typedef enum
   SD_ERROR_WRITE_DATA,
   SD_ERROR_READ_DATA,
   SD_ERROR_SET_BLOCKLEN,
-  SD_ERROR_UNKNOWN
+  SD_ERROR_UNKNOWN,
+  SD_PENDING
 } SD_Result_t;
 
 extern SD_Result_t SDC_Init(void);
+extern SD_Result_t SDC_InitStart(void);
+extern SD_Result_t SDC_InitStep(void);
 extern SD_Result_t SDC_GetSector (uint32_t Addr, uint8_t *pBuffer);
 extern SD_Result_t SDC_PutSector (uint32_t Addr, const uint8_t *pBuffer);
 extern SD_Result_t SDC_Deinit(void);
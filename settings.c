@@ -57,7 +57,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <avr/eeprom.h>
 #include "printf_P.h"
+#include "crc16.h"
 #include "fat16.h"
 #include "settings.h"
 #include "uart0.h"
@@ -77,9 +79,25 @@ Parameter_t CFG_Parameter[] =
 {
   //{PID             , "1234567890123456" , Group, Value, Default,   Min, 	Max },
 	{PID_KML_LOGGING , "KMLLogging      " ,     1,   500,     500,    0,	60000}, // the log interval for KML logging, 0 = off
-	{PID_GPX_LOGGING , "GPXLogging      " ,     1,  1000,    1000,    0, 	60000}   // the log interval for GPX logging, 0 = off
+	{PID_GPX_LOGGING , "GPXLogging      " ,     1,  1000,    1000,    0, 	60000},  // the log interval for GPX logging, 0 = off
+	{PID_UBX_LOGGING , "UBXLogging      " ,     1,     0,       0,    0, 	    1}   // log the raw data of the gps receiver, 0 = off
 };
 
+#define PARAM_COUNT 	(sizeof(CFG_Parameter) / sizeof(Parameter_t))
+
+// the parameter values parsed from the settings file are kept in the eeprom,
+// so the file has to be parsed again only if it has been changed.
+typedef struct
+{
+	uint8_t		Count;					// number of parameters, invalidates the snapshot if the parameter table changes
+	uint32_t	FileSize;				// size of the settings file the values have been parsed from
+	uint32_t	FileDateTime;			// dos date time of the settings file the values have been parsed from
+	uint16_t	Value[PARAM_COUNT];		// the parameter values
+	uint16_t	CRC;					// crc16 of all bytes above
+} __attribute__((packed)) Snapshot_t;
+
+Snapshot_t EEMEM EE_Snapshot;
+
 
 //----------------------------------------------------------------------------------
 // initialize all parameters by its default value
@@ -93,6 +111,46 @@ void Settings_SetDefaultValues(void)
 	}
 }
 
+//----------------------------------------------------------------------------------
+// read the settings snapshot from the eeprom
+// returns 1 if the snapshot is valid and matches the parameter table
+uint8_t Settings_ReadSnapshot(Snapshot_t *pSnapshot)
+{
+	eeprom_read_block(pSnapshot, &EE_Snapshot, sizeof(Snapshot_t));
+	if(pSnapshot->Count != PARAM_COUNT) return(0);
+	if(pSnapshot->CRC != CRC16((uint8_t *)pSnapshot, sizeof(Snapshot_t) - sizeof(pSnapshot->CRC))) return(0);
+	return(1);
+}
+
+//----------------------------------------------------------------------------------
+// set all parameters from a valid snapshot
+void Settings_SetSnapshotValues(Snapshot_t *pSnapshot)
+{
+	uint8_t i;
+	for (i = 0; i < PARAM_COUNT; i++)
+	{
+		CFG_Parameter[i].Value = pSnapshot->Value[i];
+	}
+}
+
+//----------------------------------------------------------------------------------
+// store the current parameter values together with the size and date of the settings file
+void Settings_WriteSnapshot(uint32_t FileSize, uint32_t FileDateTime)
+{
+	Snapshot_t snapshot;
+	uint8_t i;
+
+	snapshot.Count = PARAM_COUNT;
+	snapshot.FileSize = FileSize;
+	snapshot.FileDateTime = FileDateTime;
+	for (i = 0; i < PARAM_COUNT; i++)
+	{
+		snapshot.Value[i] = CFG_Parameter[i].Value;
+	}
+	snapshot.CRC = CRC16((uint8_t *)&snapshot, sizeof(Snapshot_t) - sizeof(snapshot.CRC));
+	eeprom_write_block(&snapshot, &EE_Snapshot, sizeof(Snapshot_t));
+}
+
 //----------------------------------------------------------------------------------
 // set parameter from string based name and value
 uint8_t Settings_SetParameterFromString(int8_t *name, int8_t *value)
@@ -140,9 +198,12 @@ void Settings_Init(void)
 	char *name, *value;
 	uint8_t i;
 	char *tmp;
+	Snapshot_t snapshot;
+	uint8_t snapshotvalid;
 
 	printf("\r\n Settings init...");
 	Settings_SetDefaultValues();
+	snapshotvalid = Settings_ReadSnapshot(&snapshot);
 
 	if(Fat16_IsValid())
 	{	// check if settings file is existing
@@ -154,6 +215,14 @@ void Settings_Init(void)
 				printf("ERROR: Opening settings file!");
 				return;
 			}
+			// file unchanged since the values have been stored?
+			if(snapshotvalid && (snapshot.FileSize == fp->Size) && (snapshot.FileDateTime == fp->DateTime))
+			{
+				Settings_SetSnapshotValues(&snapshot);
+				fclose_(fp);
+				printf("ok (unchanged)");
+				return;
+			}
 			// read all lines from file
 			while(fgets_(settingsline, LINE_MAX, fp) != NULL)
 			{
@@ -173,6 +242,7 @@ void Settings_Init(void)
 					}
 				}
 			}
+			Settings_WriteSnapshot(fp->Size, fp->DateTime);
 			fclose_(fp);
 			printf("ok");
 			return;
@@ -199,7 +269,12 @@ void Settings_Init(void)
 	}
 	else // no acces to fat 16 filesystem
 	{
-		printf("Using default values!");
+		if(snapshotvalid) // use the values of the last settings file read
+		{
+			Settings_SetSnapshotValues(&snapshot);
+			printf("Using stored values!");
+		}
+		else printf("Using default values!");
 		return;
 	}
 }
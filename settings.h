@@ -4,7 +4,8 @@
 typedef enum
 {
 	PID_KML_LOGGING,
-	PID_GPX_LOGGING
+	PID_GPX_LOGGING,
+	PID_UBX_LOGGING
 } ParamId_t;
 
 void Settings_Init(void);
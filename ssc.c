@@ -1,5 +1,6 @@
 #include <avr/io.h>
 #include "ssc.h"
+#include "crc16.h"
 
 //-------------------------------------- Hardware specific definitions --------------------------------------
 #define PORTR_SPI			PINB
@@ -174,6 +175,71 @@ void SSC_PutChar (uint8_t Byte)
 }
 
 
+//________________________________________________________________________________________________________________________________________
+// Function: 	SSC_PutBlock(const uint8_t *pBuffer, uint16_t len, uint16_t *pCRC16);
+//
+// Description:	This function writes a block of data to the SSC. If pCRC16 is not NULL the crc16 at that location
+//				is updated by every byte of the block while the previous byte is shifted out by the spi hardware.
+//
+// Returnvalue: none
+//________________________________________________________________________________________________________________________________________
+
+void SSC_PutBlock(const uint8_t *pBuffer, uint16_t len, uint16_t *pCRC16)
+{
+	uint16_t crc16;
+	uint8_t Byte;
+
+	if(!len) return;
+
+	Byte = *pBuffer++;
+	#ifdef __SD_INTERFACE_INVERTED
+	SPDR = ~Byte; 										// start transmission of the first byte
+	#else
+	SPDR =  Byte; 										// start transmission of the first byte
+	#endif
+	if(pCRC16 != 0)
+	{
+		crc16 = *pCRC16;
+		while(1)
+		{
+			crc16 = CRC16_UPDATE(crc16, Byte);			// update the crc while the spi hardware is busy
+			if(!--len) break;
+			Byte = *pBuffer++;							// fetch the next byte
+			while(!(SPSR & (1<<SPIF)))
+			{
+				// wait until the previous byte has been sent.
+			}
+			#ifdef __SD_INTERFACE_INVERTED
+			SPDR = ~Byte;
+			#else
+			SPDR =  Byte;
+			#endif
+		}
+		*pCRC16 = crc16;
+	}
+	else
+	{
+		while(--len)
+		{
+			Byte = *pBuffer++;							// fetch the next byte
+			while(!(SPSR & (1<<SPIF)))
+			{
+				// wait until the previous byte has been sent.
+			}
+			#ifdef __SD_INTERFACE_INVERTED
+			SPDR = ~Byte;
+			#else
+			SPDR =  Byte;
+			#endif
+		}
+	}
+	while(!(SPSR & (1<<SPIF)))
+	{
+		// wait until the last byte has been sent.
+	}
+}
+
+
 //________________________________________________________________________________________________________________________________________
 // Function: 	SSC_Disable(void);
 //
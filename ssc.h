@@ -13,6 +13,7 @@
 extern void 	SSC_Init(void);
 extern uint8_t	SSC_GetChar(void);
 extern void 	SSC_PutChar(uint8_t);
+extern void		SSC_PutBlock(const uint8_t *pBuffer, uint16_t len, uint16_t *pCRC16);
 extern void 	SSC_Enable(void);
 extern void 	SSC_Disable(void);
 extern void		SSC_Deinit(void);
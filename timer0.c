@@ -1,12 +1,25 @@
 #include <inttypes.h>
+#include <stddef.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
 #include "timer0.h"
+#include "analog.h"
 
-volatile uint16_t CountMilliseconds = 0;
+// timer 0 interrupt every ms, SYSCLK / 64 / 1 kHz
+#define TIMER0_PERIOD		(F_CPU / 64 / 1000)
+#if TIMER0_PERIOD > 256
+#error "timer 0 can not generate 1 ms at this F_CPU"
+#endif
+// the timer wheel
+#define TIMER_SLOTS			16		// must be a power of two
+
+volatile uint32_t SystemMilliseconds = 0;
 DateTime_t SystemTime;
 
+Timer_t *Timer_Wheel[TIMER_SLOTS];				// the active timers by their expiry
+uint32_t Timer_Time = 0;						// the last ms processed by Timer_Update()
+
 volatile uint16_t BeepTime = 0;
 volatile uint16_t BeepModulation = 0xFFFF;
 
@@ -38,13 +51,13 @@ void TIMER0_Init(void)
 
 	// Timer/Counter 0 Control Register B
 
-	// set clock devider for timer 0 to SYSKLOCK/8 = 20MHz / 8 = 2.5MHz
-	// i.e. the timer increments from 0x00 to 0xFF with an update rate of 2.5 MHz
-	// hence the timer overflow interrupt frequency is 2.5 MHz / 256 = 9.765 kHz
+	// set clock devider for timer 0 to SYSKLOCK/64 = 8MHz / 64 = 125kHz
+	// i.e. the timer increments from 0x00 to OCR0A with an update rate of 125 kHz
+	// hence the compare match interrupt frequency is 125 kHz / 125 = 1 kHz
 
-	// divider 8 (Bits CS02 = 0, CS01 = 1, CS00 = 0)
-	TCCR0B = 0x02;
-	OCR0A=100;
+	// divider 64 (Bits CS02 = 0, CS01 = 1, CS00 = 1)
+	TCCR0B = 0x03;
+	OCR0A = TIMER0_PERIOD - 1;
 	// init Timer/Counter 0 Register
     TCNT0 = 0;
 
@@ -62,7 +75,8 @@ void TIMER0_Init(void)
 	SystemTime.mSec = 0;
 	SystemTime.Valid = 0;
 
-	CountMilliseconds = 0;
+	SystemMilliseconds = 0;
+	Timer_Time = 0;
 
 	SREG = sreg;
 	sei();
@@ -73,51 +87,30 @@ void TIMER0_Init(void)
 /*****************************************************/
 /*          Interrupt Routine of Timer 0             */
 /*****************************************************/
-ISR(TIMER0_COMPA_vect)    // 9.765 kHz
-{/*static int mine=0;
-//UDR0='1';
-mine++;
-if(mine>10000)
-{mine =0;
-UDR0='0';
-
-}*/
-    static uint8_t cnt = 0;
-    #ifdef USE_FOLLOWME
-    uint8_t Beeper_On = 0;
-	#endif
-
-	if(!cnt--) // every 10th run (9.765kHz/10 = 976Hz)
-	{
-	 	cnt = 9;
-	 	CountMilliseconds++; // increment millisecond counter
-	}
+ISR(TIMER0_COMPA_vect)    // 1 kHz
+{
+	SystemMilliseconds++; // increment millisecond counter
+	ADC_Sample();
 
-	// beeper on if duration is not over
+	// the beeper is served only while a beep is active, BeepTime counts in 0.1 ms
 	if(BeepTime)
 	{
-		BeepTime--; // decrement BeepTime
-		if(BeepTime & BeepModulation) Beeper_On = 1;
-		else Beeper_On = 0;
+		if(BeepTime > 10) BeepTime -= 10;
+		else BeepTime = 0;
+		#ifdef USE_FOLLOWME
+		if(BeepTime & BeepModulation)
+		{
+			// set speaker port to high
+			PORTC |= (1<<PORTC7); // Speaker at PC7
+		}
+		else
+		{
+			// set speaker port to low
+			PORTC &= ~(1<<PORTC7);// Speaker at PC7
+		}
+		#endif
+		if(!BeepTime) BeepModulation = 0xFFFF; // beep is over
 	}
-	else // beeper off if duration is over
-	{
-		Beeper_On = 0;
-		BeepModulation = 0xFFFF;
-	}
-	 #ifdef USE_FOLLOWME
-	// if beeper is on
-	if(Beeper_On)
-	{
-		// set speaker port to high
-		PORTC |= (1<<PORTC7); // Speaker at PC7
-	}
-	else // beeper is off
-	{
-		// set speaker port to low
-		PORTC &= ~(1<<PORTC7);// Speaker at PC7
-	}
-	#endif
 }
 
 
@@ -133,6 +126,117 @@ int8_t CheckDelay(uint16_t t)
   return(((t - CountMilliseconds) & 0x8000) >> 8); // check sign bit
 }
 
+// -----------------------------------------------------------------------
+// reads the 32 bit ms counter atomically
+uint32_t GetMilliseconds(void)
+{
+	uint8_t sreg = SREG;
+	uint32_t ms;
+
+	cli();
+	ms = SystemMilliseconds;
+	SREG = sreg;
+	return(ms);
+}
+
+// -----------------------------------------------------------------------
+// captures the time in us, it wraps after 71 minutes
+uint32_t GetMicroseconds(void)
+{
+	uint8_t sreg = SREG;
+	uint32_t ms;
+	uint8_t tcnt;
+	uint16_t us;
+
+	cli();
+	ms = SystemMilliseconds;
+	tcnt = TCNT0;
+	if(TIFR0 & (1<<OCF0A)) // the compare interrupt is pending
+	{
+		tcnt = TCNT0;
+		us = 1000;
+	}
+	else us = 0;
+	SREG = sreg;
+	us += ((uint16_t)tcnt * 64) / (F_CPU / 1000000UL);
+	return(ms * 1000 + us);
+}
+
+// -----------------------------------------------------------------------
+// inserts the timer into the slot of its expiry
+static void Timer_Insert(Timer_t *pTimer)
+{
+	Timer_t **ppSlot = &Timer_Wheel[pTimer->Expiry & (TIMER_SLOTS - 1)];
+
+	pTimer->pNext = *ppSlot;
+	*ppSlot = pTimer;
+	pTimer->Active = 1;
+}
+
+// -----------------------------------------------------------------------
+// starts the timer, the callback is called after the delay in ms and then every interval ms if it is not 0
+void Timer_Start(Timer_t *pTimer, uint32_t delay, uint32_t interval, void (*pCallback)(void))
+{
+	Timer_Stop(pTimer);
+	if(!delay) delay = 1; // not within the current call of Timer_Update()
+	pTimer->Expiry = GetMilliseconds() + delay;
+	pTimer->Interval = interval;
+	pTimer->pCallback = pCallback;
+	Timer_Insert(pTimer);
+}
+
+// -----------------------------------------------------------------------
+void Timer_Stop(Timer_t *pTimer)
+{
+	Timer_t **ppTimer;
+
+	if(!pTimer->Active) return;
+	ppTimer = &Timer_Wheel[pTimer->Expiry & (TIMER_SLOTS - 1)];
+	while(*ppTimer != NULL)
+	{
+		if(*ppTimer == pTimer)
+		{
+			*ppTimer = pTimer->pNext;
+			break;
+		}
+		ppTimer = &((*ppTimer)->pNext);
+	}
+	pTimer->Active = 0;
+}
+
+// -----------------------------------------------------------------------
+// Has to be called periodically from the main loop.
+// Walks through the slots of the ms elapsed since the last call and calls the callbacks of the expired timers.
+// Timers that expire in a later turn of the wheel stay in their slot.
+void Timer_Update(void)
+{
+	uint32_t now = GetMilliseconds();
+	Timer_t *pTimer;
+
+	while((int32_t)(now - Timer_Time) > 0)
+	{
+		Timer_Time++;
+		pTimer = Timer_Wheel[Timer_Time & (TIMER_SLOTS - 1)];
+		while(pTimer != NULL)
+		{
+			if((int32_t)(Timer_Time - pTimer->Expiry) >= 0)
+			{
+				Timer_Stop(pTimer);
+				if(pTimer->Interval)
+				{
+					pTimer->Expiry += pTimer->Interval;
+					if((int32_t)(Timer_Time - pTimer->Expiry) >= 0) pTimer->Expiry = Timer_Time + pTimer->Interval; // skip the missed intervals
+					Timer_Insert(pTimer);
+				}
+				pTimer->pCallback();
+				// the callback may have changed this slot, start again at its first timer
+				pTimer = Timer_Wheel[Timer_Time & (TIMER_SLOTS - 1)];
+			}
+			else pTimer = pTimer->pNext;
+		}
+	}
+}
+
 // -----------------------------------------------------------------------
 void Delay_ms(uint16_t w)
 {
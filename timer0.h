@@ -2,6 +2,8 @@
 #define _TIMER0_H
 
 #include <inttypes.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 
 typedef struct{
 	uint16_t	Year;
@@ -16,7 +18,31 @@ typedef struct{
 
 extern DateTime_t SystemTime;
 
-extern volatile uint16_t CountMilliseconds;
+// ms since power on, the low word is the 16 bit counter used by SetDelay() and CheckDelay()
+extern volatile uint32_t SystemMilliseconds;
+
+// reads the low word atomically, the timer interrupt may change it between the two byte reads
+static inline uint16_t Timer_GetCount(void)
+{
+	uint8_t sreg = SREG;
+	uint16_t ms;
+
+	cli();
+	ms = (uint16_t)SystemMilliseconds;
+	SREG = sreg;
+	return(ms);
+}
+#define CountMilliseconds	Timer_GetCount()
+
+// a timer of the timer wheel, the callback is called from Timer_Update() in the main loop
+typedef struct Timer_s
+{
+	uint32_t		Expiry;			// in ms
+	uint32_t		Interval;		// in ms, 0 = single shot
+	void			(*pCallback)(void);
+	struct Timer_s	*pNext;			// next timer in the same slot of the wheel
+	uint8_t			Active;
+} Timer_t;
 
 extern volatile uint16_t BeepTime;
 extern volatile uint16_t BeepModulation;
@@ -26,5 +52,11 @@ extern void Delay_ms(uint16_t w);
 extern void Delay_ms_Mess(uint16_t w);
 extern uint16_t SetDelay (uint16_t t);
 extern int8_t CheckDelay (uint16_t t);
+// the delays above are limited to 32 s, the functions below work on the 32 bit time
+extern uint32_t GetMilliseconds(void);
+extern uint32_t GetMicroseconds(void);
+extern void Timer_Start(Timer_t *pTimer, uint32_t delay, uint32_t interval, void (*pCallback)(void));
+extern void Timer_Stop(Timer_t *pTimer);
+extern void Timer_Update(void);
 
 #endif //_TIMER0_H
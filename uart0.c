@@ -17,6 +17,8 @@
 #include "timer0.h"
 #include "uart0.h"
 #include "ubx.h"
+#include "gps.h"
+#include "sched.h"
 #include "printf_P.h"
 
 
@@ -39,16 +41,71 @@ uint8_t Request_ExternalControl = FALSE;
 uint8_t Request_DebugData 		= FALSE;
 uint8_t Request_DebugLabel 		= 255;
 uint8_t Request_SendFollowMe	= FALSE;
+uint8_t Request_UbxStat			= FALSE;
+uint8_t Request_Latency			= FALSE;
+uint8_t Request_TaskStat		= FALSE;
 uint8_t DisplayLine = 0;
 uint8_t DisplayKeys = 0;
 
-volatile uint8_t txd_buffer[TXD_BUFFER_LEN];
-volatile uint8_t rxd_buffer_locked = FALSE;
-volatile uint8_t rxd_buffer[RXD_BUFFER_LEN];
-volatile uint8_t txd_complete = TRUE;
-volatile uint8_t ReceivedBytes = 0;
-volatile uint8_t *pRxData = 0;
-volatile uint8_t RxDataLen = 0;
+// a frame of the tx queue
+#define TXF_FREE	0	// can be filled by the main loop
+#define TXF_READY	1	// waits for the transmission
+#define TXF_SENDING	2	// is sent by the tx isr
+
+// a data buffer of a frame
+typedef struct
+{
+	const uint8_t		*pData;
+	uint8_t				Len;
+} TxData_t;
+
+// the frame is encoded by the tx isr while it is sent
+typedef struct
+{
+	TxData_t			Buffer[TXD_BUFFERS];
+	uint8_t				NumOfBuffers;
+	uint8_t				Copy[TXD_COPY_LEN];	// copy of the small buffers taken when the frame is queued
+	uint16_t			Len;		// sum of the buffer lengths
+	uint8_t				Cmd;
+	uint8_t				Addr;
+	uint8_t				Prio;		// TX_PRIO_xxx
+	uint8_t				Seq;		// frames of the same priority are sent in the order of queuing
+	volatile uint8_t	State;		// TXF_xxx
+} TxFrame_t;
+
+TxFrame_t TxFrame[TXD_FRAMES];
+volatile uint8_t TxActive = TXD_FRAMES;	// index of the frame in transmission, TXD_FRAMES = none
+uint8_t TxSeq = 0;
+// copy of a source that is changed by other tasks, it is streamed by the tx isr
+uint8_t TxSnapshot[TXD_SNAPSHOT_LEN];
+
+// the state of the encoder of the frame in transmission
+#define TXP_HEADER	0	// '#', address and command
+#define TXP_DATA	1	// modified base64 encoded data
+#define TXP_CRC		2	// checksum and '\r'
+
+uint8_t  TxPhase;		// TXP_xxx
+uint8_t  TxPos;			// position within the header, the group or the checksum
+uint8_t  TxGroup[4];	// encoded characters of the last 3 data bytes
+uint8_t  TxBuffer;		// buffer of the frame that is read
+uint8_t  TxOffset;		// position within that buffer
+uint16_t TxLeft;		// number of data bytes not yet encoded
+uint16_t TxCRC;
+
+// a receive buffer, the rx isr fills the buffers one after the other
+typedef struct
+{
+	uint8_t				Data[RXD_BUFFER_LEN];
+	uint8_t				Len;		// number of received bytes including the '\r'
+	volatile uint8_t	Locked;		// the frame is complete and waits for processing
+} RxFrame_t;
+
+RxFrame_t RxFrame[RXD_FRAMES];
+uint8_t RxWrite = 0;	// buffer filled by the rx isr
+uint8_t RxRead = 0;		// next buffer to be processed by the main loop
+volatile UART_RxStat_t UART_RxStat;
+uint8_t *pRxData = 0;
+uint8_t RxDataLen = 0;
 
 uint8_t PcAccess = 100;
 uint16_t AboTimeOut = 0;
@@ -78,28 +135,28 @@ const prog_uint8_t ANALOG_LABEL[32][16] =
     "Analog_Ch7      ",
     "UBat            ",
     "SysState        ",
-    "Debug10         ", //10
-    "Debug11         ",
-    "Debug12         ",
-    "Debug13         ",
-    "Debug14         ",
-    "Debug15         ", //15
+    "BootTime        ", //10
+    "FirstFollowMe   ",
+    "GPS RxRate      ",
+    "GPS FifoOverflow",
+    "GPS SyncLoss    ",
+    "GPS CRC Errors  ", //15
 	"Zellenzahl      ",
     "PowerOn         ",
-    "Debug18         ",
-    "Debug19         ",
-    "Debug20         ", //20
-    "Debug21         ",
-    "Debug22         ",
-    "Debug23         ",
-    "Debug24         ",
-    "Debug25         ", //25
-    "Debug26         ",
-    "Debug27         ",
-    "Debug28         ",
-    "Debug29         ",
-    "Debug30         ", //30
-    "Debug31         "
+    "GPS EpochRate   ",
+    "GPS EpochTime   ",
+    "GPS EpochJitter ", //20
+    "GPS EpochLost   ",
+    "GPS FifoMax     ",
+    "FM InnovLat     ",
+    "FM InnovLon     ",
+    "FM Interval     ", //25
+    "GPS TTFF        ", //26
+    "GPS AidFrames   ",
+    "Wakeups/s       ", //28
+    "CPU Load %      ",
+    "CPU Current 0.1m", //30
+    "Serial RxDropped"
 };
 
 
@@ -111,6 +168,7 @@ void USART0_Init (void)
 {
 	uint8_t sreg = SREG;
 	uint16_t ubrr = (uint16_t) ((uint32_t) SYSCLK/(8 * USART0_BAUD) - 1);
+	uint8_t i;
 
 	// disable all interrupts before configuration
 	cli();
@@ -164,13 +222,16 @@ void USART0_Init (void)
 	// initialize the debug timer
 	DebugData_Timer = SetDelay(DebugData_Interval);
 
-	// unlock rxd_buffer
-	rxd_buffer_locked = FALSE;
+	// unlock the rxd buffers
+	for(i = 0; i < RXD_FRAMES; i++) RxFrame[i].Locked = FALSE;
+	RxWrite = 0;
+	RxRead = 0;
 	pRxData = 0;
 	RxDataLen = 0;
 
 	// no bytes to send
-	txd_complete = TRUE;
+	for(i = 0; i < TXD_FRAMES; i++) TxFrame[i].State = TXF_FREE;
+	TxActive = TXD_FRAMES;
 
 	UART_VersionInfo.SWMajor = VERSION_MAJOR;
 	UART_VersionInfo.SWMinor = VERSION_MINOR;
@@ -184,27 +245,138 @@ void USART0_Init (void)
     printf("\r\n UART0 init...ok");
 }
 
+// --------------------------------------------------------------------------
+// returns the next data byte of the frame in transmission, 0 after the end of the data
+static uint8_t TxQueue_GetData(TxFrame_t *pFrame)
+{
+	if(!TxLeft) return(0);
+	TxLeft--;
+	while(TxOffset >= pFrame->Buffer[TxBuffer].Len) // skip to the next buffer with data
+	{
+		TxBuffer++;
+		TxOffset = 0;
+	}
+	return(pFrame->Buffer[TxBuffer].pData[TxOffset++]);
+}
+
+// --------------------------------------------------------------------------
+// encodes the next character of the frame in transmission, returns 0 after the end of the frame
+static uint8_t TxQueue_NextByte(uint8_t *pc)
+{
+	TxFrame_t *pFrame = &TxFrame[TxActive];
+	uint8_t a, b, c;
+
+	if(TxPhase == TXP_HEADER)
+	{
+		switch(TxPos++)
+		{
+			case 0:  c = '#'; break;				// Start character
+			case 1:  c = 'a' + pFrame->Addr; break;	// Address (a=0; b=1,...)
+			default: c = pFrame->Cmd;				// Command
+				TxPhase = TXP_DATA;
+				TxPos = 4; // no group encoded
+				break;
+		}
+		TxCRC += c;
+		*pc = c;
+		return(1);
+	}
+	if(TxPhase == TXP_DATA)
+	{
+		if(TxPos >= 4) // the group has been sent
+		{
+			if(TxLeft)
+			{	// encode the next 3 bytes, missing bytes at the end are sent as 0
+				a = TxQueue_GetData(pFrame);
+				b = TxQueue_GetData(pFrame);
+				c = TxQueue_GetData(pFrame);
+				TxGroup[0] = '=' + (a >> 2);
+				TxGroup[1] = '=' + (((a & 0x03) << 4) | ((b & 0xf0) >> 4));
+				TxGroup[2] = '=' + (((b & 0x0f) << 2) | ((c & 0xc0) >> 6));
+				TxGroup[3] = '=' + ( c & 0x3f);
+				TxPos = 0;
+			}
+			else
+			{
+				TxPhase = TXP_CRC;
+				TxPos = 0;
+				TxCRC %= 4096;
+			}
+		}
+		if(TxPhase == TXP_DATA)
+		{
+			c = TxGroup[TxPos++];
+			TxCRC += c;
+			*pc = c;
+			return(1);
+		}
+	}
+	switch(TxPos++)
+	{
+		case 0:  *pc = '=' + TxCRC / 64; break;
+		case 1:  *pc = '=' + TxCRC % 64; break;
+		case 2:  *pc = '\r'; break;
+		default: return(0); // frame completely sent
+	}
+	return(1);
+}
+
+// --------------------------------------------------------------------------
+// starts the transmission of the queued frame with the highest priority,
+// has to be called with disabled interrupts while no frame is sent
+static void TxQueue_StartNext(void)
+{
+	uint8_t i, next = TXD_FRAMES;
+	uint8_t c;
+
+	for(i = 0; i < TXD_FRAMES; i++)
+	{
+		if(TxFrame[i].State != TXF_READY) continue;
+		if((next == TXD_FRAMES) || (TxFrame[i].Prio < TxFrame[next].Prio) ||
+		   ((TxFrame[i].Prio == TxFrame[next].Prio) && ((int8_t)(TxFrame[i].Seq - TxFrame[next].Seq) < 0))) next = i;
+	}
+	TxActive = next;
+	if(next == TXD_FRAMES) return; // queue empty
+	TxFrame[next].State = TXF_SENDING;
+	if((TxFrame[next].Prio == TX_PRIO_FOLLOWME) && (GPS_FollowMeTxState == FM_TX_SENDING))
+	{
+		GPS_FollowMeStamp.TxStartTime = CountMilliseconds;
+	}
+	// reset the encoder
+	TxPhase = TXP_HEADER;
+	TxPos = 0;
+	TxBuffer = 0;
+	TxOffset = 0;
+	TxLeft = TxFrame[next].Len;
+	TxCRC = 0;
+	TxQueue_NextByte(&c);
+	UDR0 = c; // initiates the transmission (continued in the TXD ISR)
+}
+
 /****************************************************************/
 /*               USART0 transmitter ISR                         */
 /****************************************************************/
 ISR(USART0_TX_vect)
 {
-	static uint16_t ptr_txd_buffer = 0;
-	uint8_t tmp_tx;
-	if(!txd_complete) // transmission not completed
+	TxFrame_t *pFrame;
+	uint8_t c;
+
+	if(TxActive >= TXD_FRAMES) return; // nothing to send
+	if(TxQueue_NextByte(&c))
 	{
-		ptr_txd_buffer++;                    // die [0] wurde schon gesendet
-		tmp_tx = txd_buffer[ptr_txd_buffer];
-		// if terminating character or end of txd buffer was reached
-		if((tmp_tx == '\r') || (ptr_txd_buffer == TXD_BUFFER_LEN))
-		{
-			ptr_txd_buffer = 0; // reset txd pointer
-			txd_complete = 1; // stop transmission
-		}
-		UDR0 = tmp_tx; // send current byte will trigger this ISR again
+		UDR0 = c; // send current byte will trigger this ISR again
+		return;
 	}
-	// transmission completed
-	else ptr_txd_buffer = 0;
+	// transmission of the frame completed
+	pFrame = &TxFrame[TxActive];
+	if((pFrame->Prio == TX_PRIO_FOLLOWME) && (GPS_FollowMeTxState == FM_TX_SENDING))
+	{
+		GPS_FollowMeStamp.TxDoneTime = CountMilliseconds;
+		GPS_FollowMeTxState = FM_TX_DONE;
+	}
+	pFrame->State = TXF_FREE;
+	// continue with the next frame without a gap on the wire
+	TxQueue_StartNext();
 }
 
 /****************************************************************/
@@ -214,12 +386,17 @@ ISR(USART0_RX_vect)
 {
 	static uint16_t crc;
 	static uint8_t ptr_rxd_buffer = 0;
+	uint8_t *rxd_buffer = RxFrame[RxWrite].Data;
 	uint8_t crc1, crc2;
 	uint8_t c;
 
 	c = UDR0;  // catch the received byte
 
-	if(rxd_buffer_locked) return; // if rxd buffer is locked immediately return
+	if(RxFrame[RxWrite].Locked) // all buffers wait for processing
+	{
+		if(c == '#') UART_RxStat.Dropped++; // the start of a frame is lost
+		return;
+	}
 
 	// the rxd buffer is unlocked
 	if((ptr_rxd_buffer == 0) && (c == '#')) // if rxd buffer is empty and syncronisation character is received
@@ -234,6 +411,9 @@ ISR(USART0_RX_vect)
 		crc += c; // update crc
 	}
 	#endif
+	else if (ptr_rxd_buffer == 0) // wait for the syncronisation character
+	{
+	}
 	else if (ptr_rxd_buffer < RXD_BUFFER_LEN) // collect incomming bytes
 	{
 		if(c != '\r') // no termination character
@@ -241,6 +421,11 @@ ISR(USART0_RX_vect)
 			rxd_buffer[ptr_rxd_buffer++] = c; // copy byte to rxd buffer
 			crc += c; // update crc
 		}
+		else if(ptr_rxd_buffer < 5) // too short for address, command and checksum
+		{
+			UART_RxStat.CRCErrors++;
+			ptr_rxd_buffer = 0;
+		}
 		else // termination character was received
 		{
 			// the last 2 bytes are no subject for checksum calculation
@@ -255,14 +440,16 @@ ISR(USART0_RX_vect)
 			if((crc1 == rxd_buffer[ptr_rxd_buffer-2]) && (crc2 == rxd_buffer[ptr_rxd_buffer-1]))
 			{   // checksum valid
 				rxd_buffer[ptr_rxd_buffer] = '\r'; // set termination character
-				ReceivedBytes = ptr_rxd_buffer + 1;// store number of received bytes
-				rxd_buffer_locked = TRUE;          // lock the rxd buffer
+				RxFrame[RxWrite].Len = ptr_rxd_buffer + 1;// store number of received bytes
+				RxFrame[RxWrite].Locked = TRUE;          // lock the rxd buffer until it is processed
+				if(++RxWrite >= RXD_FRAMES) RxWrite = 0; // continue with the next buffer
+				UART_RxStat.Frames++;
 				// if 2nd byte is an 'R' enable watchdog that will result in an reset
 				if(rxd_buffer[2] == 'R') {wdt_enable(WDTO_250MS);} // Reset-Commando
 			}
 			else
 			{	// checksum invalid
-				rxd_buffer_locked = FALSE; // unlock rxd buffer
+				UART_RxStat.CRCErrors++;
 			}
 			ptr_rxd_buffer = 0; // reset rxd buffer pointer
 		}
@@ -270,113 +457,119 @@ ISR(USART0_RX_vect)
 	else // rxd buffer overrun
 	{
 		ptr_rxd_buffer = 0; // reset rxd buffer
-		rxd_buffer_locked = FALSE; // unlock rxd buffer
+		UART_RxStat.Overruns++;
 	}
 
 }
 
 
 // --------------------------------------------------------------------------
-void AddCRC(uint16_t datalen)
+// returns the number of free frames of the tx queue
+static uint8_t TxQueue_Free(void)
 {
-	uint16_t tmpCRC = 0, i;
-	for(i = 0; i < datalen; i++)
+	uint8_t i, free = 0;
+
+	for(i = 0; i < TXD_FRAMES; i++)
 	{
-		tmpCRC += txd_buffer[i];
+		if(TxFrame[i].State == TXF_FREE) free++;
 	}
-	tmpCRC %= 4096;
-	txd_buffer[i++] = '=' + tmpCRC / 64;
-	txd_buffer[i++] = '=' + tmpCRC % 64;
-	txd_buffer[i++] = '\r';
-	txd_complete = FALSE;
-	UDR0 = txd_buffer[0]; // initiates the transmittion (continued in the TXD ISR)
+	return(free);
 }
 
-
-
 // --------------------------------------------------------------------------
-void SendOutData(uint8_t cmd, uint8_t addr, uint8_t numofbuffers, ...) // uint8_t *pdata, uint8_t len, ...
+// returns 1 while a queued frame or the frame on the wire reads the buffer
+static uint8_t TxQueue_Busy(const void *pData)
 {
-	va_list ap;
-	uint16_t pt = 0;
-	uint8_t a,b,c;
-	uint8_t ptr = 0;
+	uint8_t i, j;
 
-	uint8_t *pdata = 0;
-	int len = 0;
+	for(i = 0; i < TXD_FRAMES; i++)
+	{
+		if(TxFrame[i].State == TXF_FREE) continue;
+		for(j = 0; j < TxFrame[i].NumOfBuffers; j++)
+		{
+			if(TxFrame[i].Buffer[j].pData == pData) return(1);
+		}
+	}
+	return(0);
+}
 
-	txd_buffer[pt++] = '#';			// Start character
-	txd_buffer[pt++] = 'a' + addr;	// Address (a=0; b=1,...)
-	txd_buffer[pt++] = cmd;			// Command
+// --------------------------------------------------------------------------
+// returns a free frame of the tx queue, the caller has checked TxQueue_Free() before
+static TxFrame_t *TxQueue_Alloc(void)
+{
+	uint8_t i;
 
-	va_start(ap, numofbuffers);
-	if(numofbuffers)
+	for(i = 0; i < TXD_FRAMES - 1; i++)
 	{
-		pdata = va_arg(ap, uint8_t*);
-		len = va_arg(ap, int);
-		ptr = 0;
-		numofbuffers--;
+		if(TxFrame[i].State == TXF_FREE) break;
 	}
+	return(&TxFrame[i]);
+}
 
-	while(len)
+// --------------------------------------------------------------------------
+// queues a frame for transmission, the data is encoded by the tx isr.
+// Buffers that fit into the TXD_COPY_LEN bytes of the frame are copied, so their sources can change at once.
+// Larger buffers are read by the tx isr from their source, that must not change until TxQueue_Busy() returns 0.
+// Returns 0 if the frame has more than TXD_BUFFERS buffers, it is not sent then.
+uint8_t SendOutData(uint8_t prio, uint8_t cmd, uint8_t addr, uint8_t numofbuffers, ...) // uint8_t *pdata, uint8_t len, ...
+{
+	va_list ap;
+	uint8_t i, sreg, len, copied = 0;
+	const uint8_t *pData;
+	TxFrame_t *pFrame = TxQueue_Alloc();
+
+	if(numofbuffers > TXD_BUFFERS) return(0);
+	pFrame->Cmd = cmd;
+	pFrame->Addr = addr;
+	pFrame->Len = 0;
+	va_start(ap, numofbuffers);
+	for(i = 0; i < numofbuffers; i++)
 	{
-		if(len)
-		{
-			a = pdata[ptr++];
-			len--;
-			if((!len) && numofbuffers)
-			{
-				pdata = va_arg(ap, uint8_t*);
-				len = va_arg(ap, int);
-				ptr = 0;
-				numofbuffers--;
-			}
-		}
-		else a = 0;
-		if(len)
-		{
-			b = pdata[ptr++];
-			len--;
-			if((!len) && numofbuffers)
-			{
-				pdata = va_arg(ap, uint8_t*);
-				len = va_arg(ap, int);
-				ptr = 0;
-				numofbuffers--;
-			}
-		}
-		else b = 0;
-		if(len)
+		pData = va_arg(ap, uint8_t*);
+		len = (uint8_t)va_arg(ap, int);
+		if(len <= TXD_COPY_LEN - copied)
 		{
-			c = pdata[ptr++];
-			len--;
-			if((!len) && numofbuffers)
-			{
-				pdata = va_arg(ap, uint8_t*);
-				len = va_arg(ap, int);
-				ptr = 0;
-				numofbuffers--;
-			}
+			memcpy(&pFrame->Copy[copied], pData, len);
+			pData = &pFrame->Copy[copied];
+			copied += len;
 		}
-		else c = 0;
-		txd_buffer[pt++] = '=' + (a >> 2);
-		txd_buffer[pt++] = '=' + (((a & 0x03) << 4) | ((b & 0xf0) >> 4));
-		txd_buffer[pt++] = '=' + (((b & 0x0f) << 2) | ((c & 0xc0) >> 6));
-		txd_buffer[pt++] = '=' + ( c & 0x3f);
+		pFrame->Buffer[i].pData = pData;
+		pFrame->Buffer[i].Len = len;
+		pFrame->Len += len;
 	}
 	va_end(ap);
-	AddCRC(pt); // add checksum after data block and initates the transmission
+	pFrame->NumOfBuffers = numofbuffers;
+	pFrame->Prio = prio;
+	pFrame->Seq = TxSeq++;
+	sreg = SREG;
+	cli();
+	pFrame->State = TXF_READY;
+	if(TxActive >= TXD_FRAMES) TxQueue_StartNext(); // the transmitter is idle
+	SREG = sreg;
+	return(1);
+}
+
+// --------------------------------------------------------------------------
+// queues a frame with a copy of a source that is changed by other tasks, the caller has checked TxQueue_Busy(TxSnapshot) before.
+// Returns 0 if the source is larger than the snapshot, it is not sent then.
+static uint8_t SendOutSnapshot(uint8_t prio, uint8_t cmd, uint8_t addr, const void *pData, uint8_t len)
+{
+	if(len > TXD_SNAPSHOT_LEN) return(0);
+	memcpy(TxSnapshot, pData, len);
+	return(SendOutData(prio, cmd, addr, 1, TxSnapshot, len));
 }
 
 
 // --------------------------------------------------------------------------
-void Decode64(void)
+// decodes the data of a received frame in place
+void Decode64(RxFrame_t *pFrame)
 {
+	uint8_t *rxd_buffer = pFrame->Data;
 	uint8_t a,b,c,d;
 	uint8_t x,y,z;
 	uint8_t ptrIn = 3;
 	uint8_t ptrOut = 3;
-	uint8_t len = ReceivedBytes - 6;
+	uint8_t len = ((pFrame->Len - 6) / 4) * 3; // 3 data bytes per 4 characters between the command and the checksum
 
 	while(len)
 	{
@@ -402,80 +595,95 @@ void Decode64(void)
 // --------------------------------------------------------------------------
 void USART0_ProcessRxData(void)
 {
-	// if data in the rxd buffer are not locked immediately return
-	if(!rxd_buffer_locked) return;
-
-	Decode64(); // decode data block in rxd_buffer
-
+	RxFrame_t *pFrame;
+	uint8_t *rxd_buffer;
 
-	switch(rxd_buffer[1] - 'a')
+	// process the received frames in the order of their reception
+	while(RxFrame[RxRead].Locked)
 	{
-		case FM_ADDRESS:
+		pFrame = &RxFrame[RxRead];
+		rxd_buffer = pFrame->Data;
+		Decode64(pFrame); // decode data block in rxd_buffer
 
-			switch(rxd_buffer[2])
-			{
-				default:
-					//unsupported command received
-					break;
-			} // case FC_ADDRESS:
-
-		default: // any Slave Address
-
-		switch(rxd_buffer[2])
-			{
-				case 'a':// request for labels of the analog debug outputs
-					Request_DebugLabel = pRxData[0];
-					if(Request_DebugLabel > 31) Request_DebugLabel = 31;
-					PcAccess = 255;
-					break;
+		switch(rxd_buffer[1] - 'a')
+		{
+			case FM_ADDRESS:
 
-				case 'h':// request for display columns
-					PcAccess = 255;
-					if((pRxData[0] & 0x80) == 0x00) // old format
-					{
-						DisplayLine = 2;
-						Display_Interval = 0;
-					}
-					else // new format
-					{
-						DisplayKeys |= ~pRxData[0];
-						Display_Interval = (uint16_t) pRxData[1] * 10;
-						DisplayLine = 4;
-						AboTimeOut = SetDelay(ABO_TIMEOUT);
-					}
-					Request_Display = TRUE;
-					break;
+				switch(rxd_buffer[2])
+				{
+					default:
+						//unsupported command received
+						break;
+				} // case FC_ADDRESS:
 
-				case 'l':// request for display columns
-					PcAccess = 255;
-					MenuItem = pRxData[0];
-					Request_Display1 = TRUE;
-				break;
+			default: // any Slave Address
 
-				case 'v': // request for version and board release
-					Request_VerInfo = TRUE;
+			switch(rxd_buffer[2])
+				{
+					case 'a':// request for labels of the analog debug outputs
+						Request_DebugLabel = pRxData[0];
+						if(Request_DebugLabel > 31) Request_DebugLabel = 31;
+						PcAccess = 255;
+						break;
+
+					case 'h':// request for display columns
+						PcAccess = 255;
+						if((pRxData[0] & 0x80) == 0x00) // old format
+						{
+							DisplayLine = 2;
+							Display_Interval = 0;
+						}
+						else // new format
+						{
+							DisplayKeys |= ~pRxData[0];
+							Display_Interval = (uint16_t) pRxData[1] * 10;
+							DisplayLine = 4;
+							AboTimeOut = SetDelay(ABO_TIMEOUT);
+						}
+						Request_Display = TRUE;
+						break;
+
+					case 'l':// request for display columns
+						PcAccess = 255;
+						MenuItem = pRxData[0];
+						Request_Display1 = TRUE;
 					break;
 
-				case 'd': // request for the debug data
-					DebugData_Interval = (uint16_t) pRxData[0] * 10;
-					if(DebugData_Interval > 0) Request_DebugData = TRUE;
-					AboTimeOut = SetDelay(ABO_TIMEOUT);
-				break;
+					case 'v': // request for version and board release
+						Request_VerInfo = TRUE;
+						break;
 
-				case 'g':// get external control data
-					Request_ExternalControl = TRUE;
+					case 'd': // request for the debug data
+						DebugData_Interval = (uint16_t) pRxData[0] * 10;
+						if(DebugData_Interval > 0) Request_DebugData = TRUE;
+						AboTimeOut = SetDelay(ABO_TIMEOUT);
 					break;
 
-				default:
-					//unsupported command received
-					break;
+					case 'g':// get external control data
+						Request_ExternalControl = TRUE;
+						break;
+					case 'u':// request for the statistics of the gps receive path
+						Request_UbxStat = TRUE;
+						break;
+					case 'f':// request for the latency of the follow me frames
+						Request_Latency = TRUE;
+						break;
+					case 't':// request for the statistics of the tasks
+						Request_TaskStat = TRUE;
+						break;
+
+					default:
+						//unsupported command received
+						break;
+			}
+			break; // default:
 		}
-		break; // default:
+		// unlock the rxd buffer after processing
+		pRxData = 0;
+		RxDataLen = 0;
+		pFrame->Locked = FALSE;
+		if(++RxRead >= RXD_FRAMES) RxRead = 0;
 	}
-	// unlock the rxd buffer after processing
-	pRxData = 0;
-	RxDataLen = 0;
-	rxd_buffer_locked = FALSE;
 }
 
 //############################################################################
@@ -494,67 +702,95 @@ int16_t uart_putchar (int8_t c)
 
 
 //---------------------------------------------------------------------------------------------
+// queues the frames of the pending requests, as many as fit into the tx queue
 void USART0_TransmitTxData(void)
 {
-	if(!txd_complete) return;
-
 	if(CheckDelay(AboTimeOut))
 	{
 		Display_Interval = 0;
 		DebugData_Interval = 0;
 	}
 
-	if(Request_VerInfo && txd_complete)
+	// the follow me frame has the highest priority, it is sent after the frame on the wire
+	// only one follow me frame is queued at a time
+	if(Request_SendFollowMe && TxQueue_Free() && (GPS_FollowMeTxState != FM_TX_SENDING))
 	{
-		SendOutData('V', FM_ADDRESS, 1, (uint8_t *) &UART_VersionInfo, sizeof(UART_VersionInfo));
-		Request_VerInfo = FALSE;
+		if(GPS_FollowMeTxState == FM_TX_IDLE)
+		{
+			GPS_FollowMeStamp = GPSStamp;
+			GPS_FollowMeTxState = FM_TX_SENDING; // the tx isr sets the start time
+		}
+		SendOutData(TX_PRIO_FOLLOWME, 's', NC_ADDRESS, 1, (uint8_t *)&FollowMe, sizeof(FollowMe));
+		FollowMe.Position.Status = PROCESSED;
+		Request_SendFollowMe = FALSE;
 	}
-	else if( (((Display_Interval > 0) && CheckDelay(Display_Timer)) || Request_Display) && txd_complete)
+
+	// the other frames keep one frame of the queue free for the follow me frame.
+	// The display buffer is sent from its source, it is updated only after the last display frame has been sent.
+	// DebugOut, TaskStat and UbxStat are changed by other tasks, they are sent from a snapshot.
+	while(TxQueue_Free() > 1)
 	{
-		if(DisplayLine > 3)// new format
+		if(Request_VerInfo)
 		{
-			Menu_Update(DisplayKeys);
-			DisplayKeys = 0;
-			SendOutData('H', FC_ADDRESS, 1, (uint8_t *)DisplayBuff, sizeof(DisplayBuff));
+			SendOutData(TX_PRIO_REPLY, 'V', FM_ADDRESS, 1, (uint8_t *) &UART_VersionInfo, sizeof(UART_VersionInfo));
+			Request_VerInfo = FALSE;
 		}
-		else // old format
+		else if((((Display_Interval > 0) && CheckDelay(Display_Timer)) || Request_Display) && !TxQueue_Busy(DisplayBuff))
 		{
-			//LCD_printfxy(0,0,"!!! INCOMPATIBLE !!!");
-			SendOutData('H', FC_ADDRESS, 2, &DisplayLine, sizeof(DisplayLine), (uint8_t *)DisplayBuff, 20);
-			if(DisplayLine++ > 3) DisplayLine = 0;
+			if(DisplayLine > 3)// new format
+			{
+				Menu_Update(DisplayKeys);
+				DisplayKeys = 0;
+				SendOutData(TX_PRIO_REPLY, 'H', FC_ADDRESS, 1, (uint8_t *)DisplayBuff, sizeof(DisplayBuff));
+			}
+			else // old format
+			{
+				//LCD_printfxy(0,0,"!!! INCOMPATIBLE !!!");
+				SendOutData(TX_PRIO_REPLY, 'H', FC_ADDRESS, 2, &DisplayLine, sizeof(DisplayLine), (uint8_t *)DisplayBuff, 20);
+				if(DisplayLine++ > 3) DisplayLine = 0;
+			}
+			Display_Timer = SetDelay(Display_Interval);
+			Request_Display = FALSE;
 		}
-		Display_Timer = SetDelay(Display_Interval);
-		Request_Display = FALSE;
-	}
-	else if(Request_Display1 && txd_complete)
-	{
-		Menu_Update(0);
-		SendOutData('L', FC_ADDRESS, 3, &MenuItem, sizeof(MenuItem), &MaxMenuItem, sizeof(MaxMenuItem), DisplayBuff, sizeof(DisplayBuff));
-		Request_Display1 = FALSE;
-	}
-	else if(Request_DebugLabel != 0xFF) // Texte fr die Analogdaten
-	{
-		uint8_t label[16]; // local sram buffer
-		memcpy_P(label, ANALOG_LABEL[Request_DebugLabel], 16); // read lable from flash to sram buffer
-		SendOutData('A', FM_ADDRESS, 2, (uint8_t *) &Request_DebugLabel, sizeof(Request_DebugLabel), label, 16);
-		Request_DebugLabel = 0xFF;
-	}
-	else if(Request_ExternalControl && txd_complete)
-	{
-		SendOutData('G', FM_ADDRESS, 1,(uint8_t *) &ExternControl, sizeof(ExternControl));
-		Request_ExternalControl = FALSE;
-	}
-	else if( (((DebugData_Interval > 0) && CheckDelay(DebugData_Timer)) || Request_DebugData) && txd_complete)
-	{
-		SendOutData('D', FM_ADDRESS, 1,(uint8_t *) &DebugOut, sizeof(DebugOut));
-		DebugData_Timer = SetDelay(DebugData_Interval);
-		Request_DebugData = FALSE;
-    }
-	else if(Request_SendFollowMe && txd_complete)
-	{
-		SendOutData('s', NC_ADDRESS, 1, (uint8_t *)&FollowMe, sizeof(FollowMe));
-		FollowMe.Position.Status = PROCESSED;
-		Request_SendFollowMe = FALSE;
+		else if(Request_Display1 && !TxQueue_Busy(DisplayBuff))
+		{
+			Menu_Update(0);
+			SendOutData(TX_PRIO_REPLY, 'L', FC_ADDRESS, 3, &MenuItem, sizeof(MenuItem), &MaxMenuItem, sizeof(MaxMenuItem), DisplayBuff, sizeof(DisplayBuff));
+			Request_Display1 = FALSE;
+		}
+		else if(Request_DebugLabel != 0xFF) // Texte fr die Analogdaten
+		{
+			uint8_t label[16]; // local sram buffer
+			memcpy_P(label, ANALOG_LABEL[Request_DebugLabel], 16); // read lable from flash to sram buffer
+			SendOutData(TX_PRIO_REPLY, 'A', FM_ADDRESS, 2, (uint8_t *) &Request_DebugLabel, sizeof(Request_DebugLabel), label, 16);
+			Request_DebugLabel = 0xFF;
+		}
+		else if(Request_ExternalControl)
+		{
+			SendOutData(TX_PRIO_REPLY, 'G', FM_ADDRESS, 1,(uint8_t *) &ExternControl, sizeof(ExternControl));
+			Request_ExternalControl = FALSE;
+		}
+		else if(Request_UbxStat && !TxQueue_Busy(TxSnapshot))
+		{
+			SendOutSnapshot(TX_PRIO_REPLY, 'U', FM_ADDRESS, &UbxStat, sizeof(UbxStat));
+			Request_UbxStat = FALSE;
+		}
+		else if((((DebugData_Interval > 0) && CheckDelay(DebugData_Timer)) || Request_DebugData) && !TxQueue_Busy(TxSnapshot))
+		{
+			SendOutSnapshot(TX_PRIO_TELEMETRY, 'D', FM_ADDRESS, &DebugOut, sizeof(DebugOut));
+			DebugData_Timer = SetDelay(DebugData_Interval);
+			Request_DebugData = FALSE;
+		}
+		else if(Request_Latency)
+		{
+			SendOutData(TX_PRIO_REPLY, 'F', FM_ADDRESS, 1, (uint8_t *)&GPS_Latency, sizeof(GPS_Latency));
+			Request_Latency = FALSE;
+		}
+		else if(Request_TaskStat && !TxQueue_Busy(TxSnapshot))
+		{
+			SendOutSnapshot(TX_PRIO_REPLY, 'T', FM_ADDRESS, &TaskStat, sizeof(TaskStat));
+			Request_TaskStat = FALSE;
+		}
+		else break; // no more requests
 	}
 }
-
@@ -4,9 +4,21 @@
 #include "ubx.h"
 
 #define RXD_BUFFER_LEN  150
-// must be at least 4('#'+Addr+'CmdID'+'\r')+ (80 * 4)/3 = 111 bytes
-#define TXD_BUFFER_LEN  150
-#define RXD_BUFFER_LEN  150
+// number of receive buffers, a frame can be received while the last ones wait for processing
+#define RXD_FRAMES		3
+// number of frames that can be queued for transmission
+#define TXD_FRAMES		4
+// max. number of data buffers of a frame, the tx isr reads them one after the other
+#define TXD_BUFFERS		3
+// small buffers are copied into the frame, up to that many bytes per frame (FollowMe has 30 bytes)
+#define TXD_COPY_LEN	32
+// size of the snapshot of a source that is changed by other tasks, the largest one is TaskStat with 80 bytes
+#define TXD_SNAPSHOT_LEN	80
+
+// priorities of the queued frames, the frame with the lowest number is sent next
+#define TX_PRIO_FOLLOWME	0	// the navigation data for the MK
+#define TX_PRIO_REPLY		1	// answers to requests
+#define TX_PRIO_TELEMETRY	2	// periodic debug data
 
 #include <inttypes.h>
 
@@ -48,6 +60,17 @@ typedef struct
 
 extern DebugOut_t DebugOut;
 
+// the statistics of the receiver
+typedef struct
+{
+	uint16_t Frames;		// number of valid frames
+	uint16_t CRCErrors;		// number of frames with a bad checksum
+	uint16_t Overruns;		// number of frames longer than RXD_BUFFER_LEN
+	uint16_t Dropped;		// number of frames lost because all receive buffers were waiting for processing
+} __attribute__((packed)) UART_RxStat_t;
+
+extern volatile UART_RxStat_t UART_RxStat;
+
 typedef struct
 {
 	uint8_t SWMajor;
@@ -2,19 +2,25 @@
 #include <avr/interrupt.h>
 
 #include "main.h"
+#include "timer0.h"
 #include "uart1.h"
 #include "printf_P.h"
 #include "ubx.h"
 
 fifo_t rxFifo;
-unsigned char rxBuffer1[1000];
+unsigned char rxBuffer1[RXD_BUFFER1_LEN];
+volatile uint16_t UbxRxTime = 0;	// arrival of the first byte of the last burst
+uint16_t UbxRxLast = 0;				// arrival of the last byte
+fifo_t txFifo;
+unsigned char txBuffer1[TXD_BUFFER1_LEN];
 /****************************************************************/
 /*              Initialization of the USART1                    */
 /****************************************************************/
 void USART1_Init (void)
 {
 	printf("\r\n UART1 init...");
-	fifo_init (&rxFifo, rxBuffer1,999);
+	fifo_init (&rxFifo, rxBuffer1, RXD_BUFFER1_LEN);
+	fifo_init (&txFifo, txBuffer1, TXD_BUFFER1_LEN);
 	// USART1 Control and Status Register A, B, C and baud rate register
 	uint8_t sreg = SREG;
 	uint16_t ubrr = (uint16_t) ((uint32_t) SYSCLK/(8 * USART1_BAUD) - 1);
@@ -66,10 +72,8 @@ void USART1_Init (void)
 	// enable interrupts at the end
 	// enable RX-Interrupt
 	UCSR1B |= (1 << RXCIE1);
-	// enable TX-Interrupt
-	UCSR1B |= (1 << TXCIE1);
-	// enable DRE interrupt
-	//UCSR1B |= (1 << UDRIE1);
+	// the TX-Interrupt is not used, the DRE interrupt is enabled by USART1_putc()
+	//UCSR1B |= (1 << TXCIE1);
 
 
 	// restore global interrupt flags
@@ -79,19 +83,78 @@ void USART1_Init (void)
 }
 
 /****************************************************************/
-/*               USART1 transmitter ISR                         */
+/*               Change the baud rate of USART1                 */
 /****************************************************************/
-/*ISR(USART1_TX_vect)
+void USART1_SetBaudrate(uint32_t baudrate)
 {
+	uint8_t sreg = SREG;
+	uint16_t ubrr = (uint16_t) ((uint32_t) SYSCLK/(8 * baudrate) - 1);
+
+	cli();
+	UBRR1H = (uint8_t)(ubrr>>8);
+	UBRR1L = (uint8_t)ubrr;
+	SREG = sreg;
+}
+
+/****************************************************************/
+/*        Check if all data have been shifted out               */
+/****************************************************************/
+uint8_t USART1_TxComplete(void)
+{
+	if(UCSR1B & (1 << UDRIE1)) return(0); // the output buffer is not empty
+	if(!(UCSR1A & (1 << TXC1))) return(0); // the last byte is still shifted out
+	return(1);
+}
+
+/****************************************************************/
+/*          Put a character to the output buffer                */
+/****************************************************************/
+int USART1_putc (const uint8_t c)
+{
+	uint8_t retval;
+
+	retval = fifo_put(&txFifo, c);
+	// enable DRE interrupt to start the transmission,
+	// the ISR can only clear this bit if the fifo is empty
+	UCSR1B |= (1 << UDRIE1);
+	return(retval);
+}
+
+/****************************************************************/
+/*              Put a block into the output buffer              */
+/****************************************************************/
+uint8_t USART1_Write(const uint8_t *pData, uint8_t len)
+{
+	if(fifo_space(&txFifo) < len) return(0); // try again later
+	fifo_put_bulk(&txFifo, pData, len);
+	UCSR1B |= (1 << UDRIE1);
+	return(1);
+}
 
+/****************************************************************/
+/*               USART1 data register empty ISR                 */
+/****************************************************************/
+ISR(USART1_UDRE_vect)
+{
+	uint8_t c;
+
+	if(fifo_get(&txFifo, &c))
+	{
+		UCSR1A |= (1 << TXC1); // clear the transmit complete flag
+		UDR1 = c;
+	}
+	else UCSR1B &= ~(1 << UDRIE1); // no more data, disable DRE interrupt
 }
-*/
+
 /****************************************************************/
 /*               USART1 receiver ISR                            */
 /****************************************************************/
 ISR(USART1_RX_vect)
-{fifo_put(&rxFifo,UDR1);
-	
-	 // and put it into the ubx protocol parser
+{
+	uint16_t now = CountMilliseconds;
 
+	// the receiver sends all messages of an epoch in one burst
+	if((uint16_t)(now - UbxRxLast) > 1) UbxRxTime = now;
+	UbxRxLast = now;
+	fifo_put(&rxFifo, UDR1); // the ubx parser reads it from the main loop
 }
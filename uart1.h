@@ -2,6 +2,8 @@
 #define _UART1_H
 
 #define USART1_BAUD 38400
+#define RXD_BUFFER1_LEN 1024	// the fifo sizes must be a power of two, about 270 ms at 38400 baud
+#define TXD_BUFFER1_LEN 128	// holds a complete aiding message
 #include "fifo.h"
 /*
 Initialize the USART und activate the receiver and transmitter
@@ -16,8 +18,25 @@ the output buffer then the return value is 1. In case of an output buffer overfl
 The isr is activated, which will send the data from the outbut buffer to the UART.
 */
 extern int USART1_putc (const uint8_t c);
+
+/*
+The block is stored in the output buffer only if it fits completely, then the return value is 1,
+otherwise nothing is stored and the return value is 0. The isr is activated like by USART1_putc().
+*/
+extern uint8_t USART1_Write(const uint8_t *pData, uint8_t len);
+
+/*
+Returns 1 if the output buffer is empty and the last character has been shifted out completely.
+*/
+extern uint8_t USART1_TxComplete(void);
+
+/*
+Changes the baud rate of the USART. The output buffer should be sent completely before.
+*/
+extern void USART1_SetBaudrate(uint32_t baudrate);
 extern fifo_t rxFifo;
-extern unsigned char rxBuffer[1000];
+// arrival of the first byte of the last burst in ms
+extern volatile uint16_t UbxRxTime;
 /*
 extern uint8_t USART1_getc_wait(void);
 extern int16_t USART1_getc_nowait(void);
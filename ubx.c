@@ -4,6 +4,8 @@
 #include "uart0.h"
 #include "printf_P.h"
 #include "uart1.h"
+#include "aid.h"
+#include "logging.h"
 
 // ------------------------------------------------------------------------------------------------
 // defines
@@ -27,16 +29,42 @@ const uint32_t 	 Leap[ 13 ] = { 0,  31,  60,  91, 121, 152, 182, 213, 244, 274,
 const uint32_t Normal[ 13 ]	= { 0,  31,  59,  90, 120, 151, 181, 212, 243, 273, 304, 334, 365 };
 
 #define LEAP_SECONDS_FROM_1980	15 // the last one was on the Dec 31th 2008
+#define TIME_MAX_STEP			10000L	// in ms, a larger step of the itow is a discontinuity of the time
 
 // message sync bytes
 #define	UBX_SYNC1_CHAR	0xB5
 #define	UBX_SYNC2_CHAR	0x62
 // protocoll identifier
 #define	UBX_CLASS_NAV	0x01
+#define	UBX_CLASS_ACK	0x05
+#define	UBX_CLASS_CFG	0x06
 // message id
 #define	UBX_ID_POSLLH	0x02
 #define UBX_ID_SOL		0x06
+#define UBX_ID_PVT		0x07
 #define	UBX_ID_VELNED	0x12
+#define UBX_ID_ACK_NAK	0x00
+#define UBX_ID_ACK_ACK	0x01
+#define UBX_ID_CFG_PRT	0x00
+#define UBX_ID_CFG_MSG	0x01
+#define UBX_ID_CFG_RATE	0x08
+#define UBX_ID_CFG_NAV5	0x24
+
+// flags of NAV-PVT
+#define PVT_VALID_DATE		0x01
+#define PVT_VALID_TIME		0x02
+#define PVT_FLAG_GNSSFIXOK	0x01
+#define PVT_FLAG_DIFFSOLN	0x02
+
+// if no NAV-PVT was received within this time the NAV-SOL/POSLLH/VELNED set is used
+#define UBX_PVT_TIMEOUT		1500 // ms
+
+// receiver configuration
+#define UBX_CFG_MEASRATE	200		// ms, navigation rate of 5 Hz
+#define UBX_CFG_DYNMODEL	6		// airborne with <1g acceleration
+#define UBX_CFG_BAUD_DEFAULT 9600	// baud rate of an unconfigured receiver
+#define UBX_CFG_TIMEOUT		250		// ms to wait for the ACK/NAK of a CFG message
+#define UBX_CFG_RETRIES		3		// number of tries for every CFG message
 
 // ------------------------------------------------------------------------------------------------
 // typedefs
@@ -105,17 +133,124 @@ typedef struct
 	uint8_t		Status;		// invalid/newdata/processed
 } __attribute__((packed)) ubx_nav_posllh_t;
 
+typedef struct
+{
+	uint32_t	itow;		// ms GPS Millisecond Time of Week
+	uint16_t	year;		// Year (UTC)
+	uint8_t		month;		// Month, range 1..12 (UTC)
+	uint8_t		day;		// Day of month, range 1..31 (UTC)
+	uint8_t		hour;		// Hour of day, range 0..23 (UTC)
+	uint8_t		min;		// Minute of hour, range 0..59 (UTC)
+	uint8_t		sec;		// Seconds of minute, range 0..60 (UTC)
+	uint8_t		valid;		// Validity Flags
+	uint32_t	tAcc;		// ns Time accuracy estimate (UTC)
+	int32_t		nano;		// ns Fraction of second, range -1e9 .. 1e9 (UTC)
+	uint8_t		fixType;	// GNSSfix Type, range 0..5
+	uint8_t		flags;		// Fix Status Flags
+	uint8_t		flags2;		// Additional flags
+	uint8_t		numSV;		// Number of satellites used in Nav Solution
+	int32_t		LON;		// 1e-07 deg Longitude
+	int32_t		LAT;		// 1e-07 deg Latitude
+	int32_t		HEIGHT;		// mm Height above Ellipsoid
+	int32_t		HMSL;		// mm Height above mean sea level
+	uint32_t	Hacc;		// mm Horizontal Accuracy Estimate
+	uint32_t	Vacc;		// mm Vertical Accuracy Estimate
+	int32_t		VEL_N;		// mm/s NED north velocity
+	int32_t		VEL_E;		// mm/s NED east velocity
+	int32_t		VEL_D;		// mm/s NED down velocity
+	int32_t		GSpeed;		// mm/s Ground Speed (2-D)
+	int32_t		HeadMot;	// 1e-05 deg Heading of motion 2-D
+	uint32_t	SAcc;		// mm/s Speed Accuracy Estimate
+	uint32_t	HeadAcc;	// 1e-05 deg Heading Accuracy Estimate
+	uint16_t	PDOP;		// 0.01 Position DOP
+	uint8_t		res1[6];	// reserved
+	int32_t		HeadVeh;	// 1e-05 deg Heading of vehicle 2-D
+	int16_t		MagDec;		// 1e-02 deg Magnetic declination
+	uint16_t	MagAcc;		// 1e-02 deg Magnetic declination accuracy
+	uint8_t		Status;		// invalid/newdata/processed
+} __attribute__((packed)) ubx_nav_pvt_t;
+
+typedef struct
+{
+	uint8_t		clsID;		// Class ID of the Acknowledged or Not-Acknowledged Message
+	uint8_t		msgID;		// Message ID of the Acknowledged or Not-Acknowledged Message
+	uint8_t		Status;		// invalid/newdata/processed
+} __attribute__((packed)) ubx_ack_t;
+
+typedef struct
+{
+	uint8_t		Data[UBX_AID_MAXLEN];	// almanac or ephemeris of a satellite
+	uint8_t		Status;		// invalid/newdata/processed
+} __attribute__((packed)) ubx_aid_t;
+
+// steps of the receiver configuration
+typedef enum
+{
+	UBXCFG_PRT,				// UBX protocol only at USART1_BAUD
+	UBXCFG_PRT_DEFAULT,		// the same at the default baud rate of the receiver
+	UBXCFG_RATE,			// navigation rate
+	UBXCFG_NAV5,			// dynamic model
+	UBXCFG_MSG_PVT,			// enable NAV-PVT
+	UBXCFG_MSG_SOL,			// disable the legacy messages if NAV-PVT is supported otherwise enable them
+	UBXCFG_MSG_POSLLH,
+	UBXCFG_MSG_VELNED,
+	UBXCFG_DONE
+} ubxCfgStep_t;
+
 
 
 //------------------------------------------------------------------------------------
 // global variables
 
-// local buffers for the incomming ubx messages
-volatile ubx_nav_sol_t		UbxSol	  = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, INVALID};
-volatile ubx_nav_posllh_t	UbxPosLlh = {0,0,0,0,0,0,0, INVALID};
-volatile ubx_nav_velned_t	UbxVelNed = {0,0,0,0,0,0,0,0,0, INVALID};
+// every navigation message has two buffers, the parser fills the back buffer
+// and swaps it with the front buffer when the checksum of the message is valid.
+// Therefore a broken message never destroys the last valid one.
+typedef struct
+{
+	uint8_t *pFront;	// the last valid message
+	uint8_t *pBack;		// the message currently received
+} ubx_slot_t;
+
+ubx_nav_sol_t		UbxSolBuf[2];
+ubx_nav_posllh_t	UbxPosLlhBuf[2];
+ubx_nav_velned_t	UbxVelNedBuf[2];
+ubx_nav_pvt_t		UbxPvtBuf[2];
+
+ubx_slot_t UbxSolSlot		= {(uint8_t *)&UbxSolBuf[0],	(uint8_t *)&UbxSolBuf[1]};
+ubx_slot_t UbxPosLlhSlot	= {(uint8_t *)&UbxPosLlhBuf[0],	(uint8_t *)&UbxPosLlhBuf[1]};
+ubx_slot_t UbxVelNedSlot	= {(uint8_t *)&UbxVelNedBuf[0],	(uint8_t *)&UbxVelNedBuf[1]};
+ubx_slot_t UbxPvtSlot		= {(uint8_t *)&UbxPvtBuf[0],	(uint8_t *)&UbxPvtBuf[1]};
+
+// the messages are read in place from the front buffers
+#define UbxSol		(*(ubx_nav_sol_t *)UbxSolSlot.pFront)
+#define UbxPosLlh	(*(ubx_nav_posllh_t *)UbxPosLlhSlot.pFront)
+#define UbxVelNed	(*(ubx_nav_velned_t *)UbxVelNedSlot.pFront)
+#define UbxPvt		(*(ubx_nav_pvt_t *)UbxPvtSlot.pFront)
+
+// local buffers for the incomming ack messages
+volatile ubx_ack_t			UbxAck;
+volatile ubx_ack_t			UbxNak;
+ubx_aid_t					UbxAid;
 
 uint16_t CheckGPSOkay = 0;
+uint8_t UbxConfigured = 0;
+UBX_Stat_t UbxStat;
+GPS_Stamp_t GPSStamp;
+uint16_t Ubx_CheckTime = 0;		// time of the last verified message
+
+// epoch timing within the current statistic interval
+uint16_t Epoch_Time = 0;			// time of the last epoch
+uint16_t Epoch_IntervalMin = 0xFFFF;
+uint16_t Epoch_IntervalMax = 0;
+Timer_t Stat_Timer;					// the rates of the statistics are updated every second
+// the legacy message set is ignored as long as the receiver sends NAV-PVT
+uint8_t Pvt_Active = 0;
+Timer_t Pvt_Timer;
+
+// the itow and week the system time has been calculated for
+uint32_t Time_Itow = 0;
+int16_t  Time_Week = 0;
+uint8_t  Time_Synced = 0;	// the system time can be advanced by the step of the itow
 
 // shared buffer
 gps_data_t  		GPSData = {{0,0,0,INVALID},0,0,0,0,0,0,0, INVALID};
@@ -129,21 +264,98 @@ uint8_t IsLeapYear(uint16_t year)
 	else return 0;
 }
 
+/********************************************************/
+/*  Counts a complete navigation epoch                  */
+/********************************************************/
+void UBX_EpochDone(void)
+{
+	uint16_t interval;
+
+	CheckGPSOkay++;
+	if(UbxStat.Epochs++)
+	{
+		interval = CountMilliseconds - Epoch_Time;
+		UbxStat.EpochInterval = interval;
+		if(interval < Epoch_IntervalMin) Epoch_IntervalMin = interval;
+		if(interval > Epoch_IntervalMax) Epoch_IntervalMax = interval;
+	}
+	Epoch_Time = CountMilliseconds;
+}
+
+/********************************************************/
+/*  Updates the rates of the receive path statistics    */
+/********************************************************/
+void UBX_UpdateStat(void)
+{
+	uint16_t overflow;
+
+	// the overflow counter is incremented by the receive ISR
+	do overflow = rxFifo.overflow;
+	while(overflow != rxFifo.overflow);
+	UbxStat.FifoOverflow = overflow;
+	UbxStat.FifoHighwater = rxFifo.highwater;
+}
+
+// called every second by the timer wheel
+static void UBX_StatRates(void)
+{
+	static uint32_t Stat_RxBytes = 0;
+	static uint16_t Stat_Epochs = 0;
+
+	UbxStat.RxRate = (uint16_t)(UbxStat.RxBytes - Stat_RxBytes);
+	Stat_RxBytes = UbxStat.RxBytes;
+	UbxStat.EpochRate = (uint8_t)(UbxStat.Epochs - Stat_Epochs);
+	Stat_Epochs = UbxStat.Epochs;
+	if(Epoch_IntervalMax >= Epoch_IntervalMin) UbxStat.EpochJitter = Epoch_IntervalMax - Epoch_IntervalMin;
+	else UbxStat.EpochJitter = 0; // no epoch within the last second
+	Epoch_IntervalMin = 0xFFFF;
+	Epoch_IntervalMax = 0;
+}
+
 /********************************************************/
 /*  Calculates the UTC Time from the GPS week and tow   */
 /********************************************************/
+// The full conversion is done once, afterwards the time is advanced by the step of the itow.
+// A day rollover, a new week or a discontinuity of the itow needs the full conversion again.
 void SetGPSTime(DateTime_t * pTimeStruct)
 {
 	uint32_t Days, Seconds, Week;
 	uint16_t YearPart;
 	uint32_t * MonthDayTab = 0;
 	uint8_t  i;
-
-
+	uint32_t step;
+	uint16_t ms;
 
 	// if GPS data show valid time data
 	if((UbxSol.Status != INVALID) && (UbxSol.Flags & FLAG_WKNSET) && (UbxSol.Flags & FLAG_TOWSET) )
 	{
+		step = UbxSol.itow - Time_Itow;
+		if(Time_Synced && pTimeStruct->Valid && (UbxSol.week == Time_Week) && (UbxSol.itow > Time_Itow) && (step <= TIME_MAX_STEP))
+		{
+			Time_Itow = UbxSol.itow;
+			ms = pTimeStruct->mSec + (uint16_t)step;
+			while(ms >= 1000)
+			{
+				ms -= 1000;
+				pTimeStruct->Sec++;
+			}
+			pTimeStruct->mSec = ms;
+			while(pTimeStruct->Sec >= 60)
+			{
+				pTimeStruct->Sec -= 60;
+				pTimeStruct->Min++;
+			}
+			if(pTimeStruct->Min >= 60)
+			{
+				pTimeStruct->Min -= 60;
+				pTimeStruct->Hour++;
+			}
+			if(pTimeStruct->Hour < 24) return; // same day
+		}
+		// full conversion
+		Time_Itow = UbxSol.itow;
+		Time_Week = UbxSol.week;
+		Time_Synced = 1;
 		Seconds = UbxSol.itow / 1000L;
 		Week = (uint32_t)UbxSol.week;
 		// correct leap seconds since 1980
@@ -199,6 +411,7 @@ void SetGPSTime(DateTime_t * pTimeStruct)
 	else
 	{
 		pTimeStruct->Valid = 0;
+		Time_Synced = 0;
 	}
 }
 
@@ -214,68 +427,175 @@ void UBX_Init(void)
 	UbxSol.Status = INVALID;
 	UbxPosLlh.Status = INVALID;
 	UbxVelNed.Status = INVALID;
+	UbxPvt.Status = INVALID;
+	UbxAck.Status = INVALID;
+	UbxNak.Status = INVALID;
 	GPSData.Status = INVALID;
+	Timer_Start(&Stat_Timer, 1000, 1000, UBX_StatRates);
 	printf("ok");
 }
 
+// iTOW a is later than iTOW b, respecting the rollover at the end of the week.
+// The difference is folded into +- half a week, i.e. 0 of the next week is later than the end of the week.
+static uint8_t Itow_Later(uint32_t a, uint32_t b)
+{
+	int32_t d = (int32_t)(a - b);
+
+	if(d > (int32_t)(SECONDS_PER_WEEK / 2) * 1000L) d -= (int32_t)SECONDS_PER_WEEK * 1000L;
+	else if(d < -(int32_t)(SECONDS_PER_WEEK / 2) * 1000L) d += (int32_t)SECONDS_PER_WEEK * 1000L;
+	return(d > 0);
+}
+
+// called by the timer wheel if no NAV-PVT arrived within UBX_PVT_TIMEOUT
+static void UBX_PvtTimeout(void)
+{
+	Pvt_Active = 0;
+}
+
 /********************************************************/
 /*            Upate GPS data stcructure                 */
 /********************************************************/
-static uint16_t Ubx_Timeout = 0;void Update_GPSData (void)
+void Update_GPSData (uint8_t id)
 {
-	static uint8_t  Msg_Count = 0;
-
-	// the timeout is used to detect the delay between two message sets
-	// and is used for synchronisation so that always a set is collected
-	// that belongs together
-	// _______NAVSOL|POSLLH|VELNED|___________________NAVSOL|POSLLH|VELNED|_____________
-	//              |  8ms | 8ms  |         184 ms          |      |      |
-	// msg_count:   0      1      2                         0      1      2
-
-	if(CheckDelay(Ubx_Timeout))	Msg_Count = 0;
-	else Msg_Count++;
-	Ubx_Timeout = SetDelay(100); // reset ubx msg timeout
-
-	// if a new set of ubx messages was collected
-	if((Msg_Count >= 2))
-	{	// if set is complete
-		if((UbxSol.Status == NEWDATA) && (UbxPosLlh.Status == NEWDATA) && (UbxVelNed.Status == NEWDATA))
-		{//UDR0='0';
-			CheckGPSOkay++;
-			// update GPS data only if the status is INVALID or PROCESSED  and the last ubx message was received within less than 100 ms
-			if(GPSData.Status != NEWDATA) // if last data were processed
-			{ // wait for new data at all neccesary ubx messages
-				GPSData.Status = INVALID;
-				// NAV SOL
-				GPSData.Flags =					UbxSol.Flags;
-				GPSData.NumOfSats = 			UbxSol.numSV;
-				GPSData.SatFix = 				UbxSol.GPSfix;
-				GPSData.Position_Accuracy =		UbxSol.PAcc;
-				GPSData.Speed_Accuracy = 		UbxSol.SAcc;
-				SetGPSTime(&SystemTime); // update system time
-				// NAV POSLLH
-				GPSData.Position.Status = 		INVALID;
-				
-				//printf("%d\n",((char *)&UbxPosLlh.LON)[0]);
-				GPSData.Position.Longitude =  	UbxPosLlh.LON;
-				GPSData.Position.Latitude =  	UbxPosLlh.LAT;
-				GPSData.Position.Altitude =  	UbxPosLlh.HMSL;
-				GPSData.Position.Status = 		NEWDATA;
-				// NAV VELNED
-				GPSData.Speed_East = 			UbxVelNed.VEL_E;
-				GPSData.Speed_North = 			UbxVelNed.VEL_N;
-				GPSData.Speed_Top 	= 			-UbxVelNed.VEL_D;
-				GPSData.Speed_Ground = 			UbxVelNed.GSpeed;
-				GPSData.Heading = 				UbxVelNed.Heading;
-
-				GPSData.Status = NEWDATA; // new data available
-			} // EOF if(GPSData.Status != NEWDATA)
-		} // EOF all ubx messages received
+	static uint32_t Epoch_Itow = 0;			// iTOW of the message set that is collected
+	static uint8_t  Epoch_Pending = 0;		// a message set is collected
+	static uint32_t Published_Itow = 0;		// iTOW of the last published message set
+	static uint8_t  Published = 0;			// a legacy message set has been published since the last NAV-PVT
+	uint32_t itow;
+
+	// NAV-PVT contains the complete fix, so it is published as soon as it is received
+	if(UbxPvt.Status == NEWDATA)
+	{
+		Pvt_Active = 1;
+		Published = 0; // Published_Itow is outdated when the receiver falls back to the legacy set
+		Timer_Start(&Pvt_Timer, UBX_PVT_TIMEOUT, 0, UBX_PvtTimeout);
+		UBX_EpochDone();
+		if(GPSData.Status != NEWDATA) // if last data were processed
+		{
+			GPSData.Status = INVALID;
+			GPSData.Flags = 0;
+			if(UbxPvt.flags & PVT_FLAG_GNSSFIXOK)	GPSData.Flags |= FLAG_GPSFIXOK;
+			if(UbxPvt.flags & PVT_FLAG_DIFFSOLN)	GPSData.Flags |= FLAG_DIFFSOLN;
+			if(UbxPvt.valid & PVT_VALID_DATE)		GPSData.Flags |= FLAG_WKNSET;
+			if(UbxPvt.valid & PVT_VALID_TIME)		GPSData.Flags |= FLAG_TOWSET;
+			GPSData.NumOfSats = 			UbxPvt.numSV;
+			GPSData.SatFix = 				UbxPvt.fixType;
+			GPSData.Position_Accuracy =		UbxPvt.Hacc / 10;	// mm -> cm
+			GPSData.Speed_Accuracy = 		UbxPvt.SAcc / 10;	// mm/s -> cm/s
+			// the receiver provides the utc time directly
+			if((UbxPvt.valid & (PVT_VALID_DATE|PVT_VALID_TIME)) == (PVT_VALID_DATE|PVT_VALID_TIME))
+			{
+				SystemTime.Year		= UbxPvt.year;
+				SystemTime.Month	= UbxPvt.month;
+				SystemTime.Day		= UbxPvt.day;
+				SystemTime.Hour		= UbxPvt.hour;
+				SystemTime.Min		= UbxPvt.min;
+				SystemTime.Sec		= UbxPvt.sec;
+				SystemTime.mSec		= (uint16_t)(UbxPvt.itow % 1000L);
+				SystemTime.Valid	= 1;
+			}
+			else SystemTime.Valid = 0;
+			Time_Synced = 0; // SetGPSTime() starts with a full conversion
+			GPSData.Position.Status = 		INVALID;
+			GPSData.Position.Longitude =  	UbxPvt.LON;
+			GPSData.Position.Latitude =  	UbxPvt.LAT;
+			GPSData.Position.Altitude =  	UbxPvt.HMSL;
+			GPSData.Position.Status = 		NEWDATA;
+			GPSData.Speed_East = 			UbxPvt.VEL_E / 10;	// mm/s -> cm/s
+			GPSData.Speed_North = 			UbxPvt.VEL_N / 10;
+			GPSData.Speed_Top 	= 			-UbxPvt.VEL_D / 10;
+			GPSData.Speed_Ground = 			UbxPvt.GSpeed / 10;
+			GPSData.Heading = 				UbxPvt.HeadMot;
+			GPSData.Status = NEWDATA; // new data available
+			GPSStamp.RxTime = UbxRxTime;
+			GPSStamp.CheckTime = Ubx_CheckTime;
+			GPSStamp.PublishTime = CountMilliseconds;
+		}
+		UbxPvt.Status = PROCESSED; // ready for new data
+		return;
+	}
+	// the legacy message set is ignored as long as the receiver sends NAV-PVT
+	if(Pvt_Active)
+	{
+		UbxSol.Status = 				PROCESSED;
+		UbxPosLlh.Status = 				PROCESSED;
+		UbxVelNed.Status = 				PROCESSED;
+		return;
+	}
+
+	// every NAV message carries the iTOW of the navigation epoch it belongs to,
+	// a set is complete as soon as all messages with the same iTOW have been received
+	switch(id)
+	{
+		case UBX_ID_SOL:	itow = UbxSol.itow;		break;
+		case UBX_ID_POSLLH:	itow = UbxPosLlh.itow;	break;
+		case UBX_ID_VELNED:	itow = UbxVelNed.itow;	break;
+		default: return;
+	}
+	if((Epoch_Pending && Itow_Later(Epoch_Itow, itow)) || (!Epoch_Pending && !Itow_Later(itow, Published_Itow) && Published))
+	{	// message of an older epoch, ignore it
+		UbxStat.EpochMismatch++;
+		switch(id)
+		{
+			case UBX_ID_SOL:	UbxSol.Status = PROCESSED;		break;
+			case UBX_ID_POSLLH:	UbxPosLlh.Status = PROCESSED;	break;
+			default:			UbxVelNed.Status = PROCESSED;	break;
+		}
+		return;
+	}
+	if(Epoch_Pending && (itow != Epoch_Itow))
+	{	// a new epoch has started before the last one was complete
+		UbxStat.EpochIncomplete++;
+		if(UbxSol.itow != itow)		UbxSol.Status = PROCESSED;
+		if(UbxPosLlh.itow != itow)	UbxPosLlh.Status = PROCESSED;
+		if(UbxVelNed.itow != itow)	UbxVelNed.Status = PROCESSED;
+	}
+	Epoch_Itow = itow;
+	Epoch_Pending = 1;
+
+	// if set is complete
+	if((UbxSol.Status == NEWDATA) && (UbxPosLlh.Status == NEWDATA) && (UbxVelNed.Status == NEWDATA))
+	{
+		UBX_EpochDone();
+		Epoch_Pending = 0;
+		Published_Itow = itow;
+		Published = 1;
+		// update GPS data only if the status is INVALID or PROCESSED
+		if(GPSData.Status != NEWDATA) // if last data were processed
+		{
+			GPSData.Status = INVALID;
+			// NAV SOL
+			GPSData.Flags =					UbxSol.Flags;
+			GPSData.NumOfSats = 			UbxSol.numSV;
+			GPSData.SatFix = 				UbxSol.GPSfix;
+			GPSData.Position_Accuracy =		UbxSol.PAcc;
+			GPSData.Speed_Accuracy = 		UbxSol.SAcc;
+			SetGPSTime(&SystemTime); // update system time
+			// NAV POSLLH
+			GPSData.Position.Status = 		INVALID;
+			
+			//printf("%d\n",((char *)&UbxPosLlh.LON)[0]);
+			GPSData.Position.Longitude =  	UbxPosLlh.LON;
+			GPSData.Position.Latitude =  	UbxPosLlh.LAT;
+			GPSData.Position.Altitude =  	UbxPosLlh.HMSL;
+			GPSData.Position.Status = 		NEWDATA;
+			// NAV VELNED
+			GPSData.Speed_East = 			UbxVelNed.VEL_E;
+			GPSData.Speed_North = 			UbxVelNed.VEL_N;
+			GPSData.Speed_Top 	= 			-UbxVelNed.VEL_D;
+			GPSData.Speed_Ground = 			UbxVelNed.GSpeed;
+			GPSData.Heading = 				UbxVelNed.Heading;
+
+			GPSData.Status = NEWDATA; // new data available
+			GPSStamp.RxTime = UbxRxTime;
+			GPSStamp.CheckTime = Ubx_CheckTime;
+			GPSStamp.PublishTime = CountMilliseconds;
+		} // EOF if(GPSData.Status != NEWDATA)
 		// set state to collect new data
 		UbxSol.Status = 				PROCESSED;	// ready for new data
 		UbxPosLlh.Status = 				PROCESSED;	// ready for new data
 		UbxVelNed.Status = 				PROCESSED;	// ready for new data
-	}
+	} // EOF all ubx messages received
 }
 
 
@@ -283,20 +603,53 @@ static uint16_t Ubx_Timeout = 0;void Update_GPSData (void)
 /*                   UBX Parser                         */
 /********************************************************/
 void UBX_Parser()
-{static int i=0;
+{
 	static ubxState_t ubxState = UBXSTATE_IDLE;
 	static uint16_t msglen;
 	static uint8_t cka, ckb;
+	static uint8_t ubxClass, ubxId;
 	static uint8_t *ubxP, *ubxEp, *ubxSp; // pointers to data currently transfered
+	static ubx_slot_t *ubxSlot; // double buffer of the current message
+	static uint8_t ubxStat; // index of the checksum error counter
+	uint8_t *ubxTmp;
+	uint8_t *pspan, *pend; // bytes of the receive buffer that are parsed in one piece
+	uint8_t *pstart;
+	uint16_t span, run;
+	uint8_t newfix = 0;
 	unsigned char c;
 
-	while(fifo_get(&rxFifo, &c)){//printf("%d %d\n",rxFifo.pread,rxFifo.pwrite);
+	while((span = fifo_get_span(&rxFifo, &pspan)) != 0)
+	{
+	pstart = pspan;
+	pend = pspan + span;
+	while(pspan < pend)
+	{
+	if (ubxState == UBXSTATE_DATA) // collecting data
+	{	// copy the payload run of this span at once
+		run = pend - pspan;
+		if (run > msglen) run = msglen;
+		msglen -= run;
+		while(run--)
+		{
+			c = *pspan++;
+			*ubxP++ = c;
+			cka += c;
+			ckb += cka;
+		}
+		if (msglen == 0) ubxState = UBXSTATE_CKA; // switch to next state if all data was read
+		continue;
+	}
+	c = *pspan++;
 	//state machine
 	switch (ubxState)	// ubx message parser
 	{
 		case UBXSTATE_IDLE: // check 1st sync byte
 			if (c == UBX_SYNC1_CHAR) ubxState = UBXSTATE_SYNC1;
-			else ubxState = UBXSTATE_IDLE; // out of synchronization
+			else
+			{
+				UbxStat.SyncLoss++;
+				ubxState = UBXSTATE_IDLE; // out of synchronization
+			}
 			break;
 
 		case UBXSTATE_SYNC1: // check 2nd sync byte
@@ -304,31 +657,81 @@ void UBX_Parser()
 			else ubxState = UBXSTATE_IDLE; // out of synchronization
 			break;
 
-		case UBXSTATE_SYNC2: // check msg class to be NAV
-			if (c == UBX_CLASS_NAV) ubxState = UBXSTATE_CLASS;
+		case UBXSTATE_SYNC2: // check msg class to be NAV or ACK
+			if ((c == UBX_CLASS_NAV) || (c == UBX_CLASS_ACK) || (c == UBX_CLASS_AID))
+			{
+				ubxClass = c;
+				ubxState = UBXSTATE_CLASS;
+			}
 			else ubxState = UBXSTATE_IDLE; // unsupported message class
 			break;
 
 		case UBXSTATE_CLASS: // check message identifier
-						
-			switch(c)
+			ubxSlot = 0;
+			ubxStat = UBX_STAT_ACK;
+			if (ubxClass == UBX_CLASS_ACK)
+			{
+				switch(c)
+				{
+					case UBX_ID_ACK_ACK: // message acknowledged
+						ubxP =  (uint8_t *)&UbxAck; // data start pointer
+						ubxEp = (uint8_t *)(&UbxAck + 1); // data end pointer
+						ubxSp = (uint8_t *)&UbxAck.Status; // status pointer
+						break;
+
+					case UBX_ID_ACK_NAK: // message not acknowledged
+						ubxP =  (uint8_t *)&UbxNak; // data start pointer
+						ubxEp = (uint8_t *)(&UbxNak + 1); // data end pointer
+						ubxSp = (uint8_t *)&UbxNak.Status; // status pointer
+						break;
+
+					default:			// unsupported identifier
+						ubxState = UBXSTATE_IDLE;
+						break;
+				}
+			}
+			else if (ubxClass == UBX_CLASS_AID)
+			{
+				if ((c == UBX_ID_AID_ALM) || (c == UBX_ID_AID_EPH)) // answer to a poll
+				{
+					ubxP =  UbxAid.Data; // data start pointer
+					ubxEp = UbxAid.Data + UBX_AID_MAXLEN; // data end pointer
+					ubxSp = (uint8_t *)&UbxAid.Status; // status pointer
+				}
+				else ubxState = UBXSTATE_IDLE; // unsupported identifier
+			}
+			else switch(c)
 			{
 				case UBX_ID_POSLLH: // geodetic position
-					ubxP =  (uint8_t *)&UbxPosLlh; // data start pointer
-					ubxEp = (uint8_t *)(&UbxPosLlh + 1); // data end pointer
-					ubxSp = (uint8_t *)&UbxPosLlh.Status; // status pointer
+					ubxSlot = &UbxPosLlhSlot;
+					ubxStat = UBX_STAT_POSLLH;
+					ubxP =  ubxSlot->pBack; // data start pointer
+					ubxEp = ubxP + sizeof(ubx_nav_posllh_t); // data end pointer
+					ubxSp = (uint8_t *)&((ubx_nav_posllh_t *)ubxP)->Status; // status pointer
 					break;
 
 				case UBX_ID_SOL: // navigation solution
-					ubxP =  (uint8_t *)&UbxSol; // data start pointer
-					ubxEp = (uint8_t *)(&UbxSol + 1); // data end pointer
-					ubxSp = (uint8_t *)&UbxSol.Status; // status pointer
+					ubxSlot = &UbxSolSlot;
+					ubxStat = UBX_STAT_SOL;
+					ubxP =  ubxSlot->pBack; // data start pointer
+					ubxEp = ubxP + sizeof(ubx_nav_sol_t); // data end pointer
+					ubxSp = (uint8_t *)&((ubx_nav_sol_t *)ubxP)->Status; // status pointer
 					break;
 
 				case UBX_ID_VELNED: // velocity vector in tangent plane
-					ubxP =  (uint8_t *)&UbxVelNed; // data start pointer
-					ubxEp = (uint8_t *)(&UbxVelNed + 1); // data end pointer
-					ubxSp = (uint8_t *)&UbxVelNed.Status; // status pointer
+					ubxSlot = &UbxVelNedSlot;
+					ubxStat = UBX_STAT_VELNED;
+					ubxP =  ubxSlot->pBack; // data start pointer
+					ubxEp = ubxP + sizeof(ubx_nav_velned_t); // data end pointer
+					ubxSp = (uint8_t *)&((ubx_nav_velned_t *)ubxP)->Status; // status pointer
+					break;
+
+				case UBX_ID_PVT: // position, velocity and time solution
+					ubxSlot = &UbxPvtSlot;
+					ubxStat = UBX_STAT_PVT;
+					ubxP =  ubxSlot->pBack; // data start pointer
+					ubxEp = ubxP + sizeof(ubx_nav_pvt_t); // data end pointer
+					ubxSp = (uint8_t *)&((ubx_nav_pvt_t *)ubxP)->Status; // status pointer
 					break;
 
 				default://printf("%d\n",UbxPosLlh.LON);			// unsupported identifier
@@ -337,9 +740,10 @@ void UBX_Parser()
 			}
 			if (ubxState != UBXSTATE_IDLE)
 			{
+				ubxId = c;
 				ubxState = UBXSTATE_LEN1;
-				cka = UBX_CLASS_NAV + c;
-				ckb = UBX_CLASS_NAV + cka;
+				cka = ubxClass + c;
+				ckb = ubxClass + cka;
 			}
 			break;
 
@@ -355,28 +759,10 @@ void UBX_Parser()
 			msglen += ((uint16_t)c)<<8; // high byte last
 			cka += c;
 			ckb += cka;
-			// if the old data are not processed so far then break parsing now
-			// to avoid writing new data in ISR during reading by another function
-
-				*ubxSp = INVALID; // mark invalid during buffer filling
-				ubxState = UBXSTATE_DATA;
-
-			break;
-
-		case UBXSTATE_DATA: // collecting data
-	//printf("%d %d\n",msglen,c);
-			if (ubxP < ubxEp)
-			{//if (ubxP ==  (uint8_t *)&UbxPosLlh)
-				//printf("%d %d\n",msglen,c);
-				*ubxP++ = c; // copy curent data byte if any space is left
-				cka += c;
-				ckb += cka;
-				if (--msglen == 0) 	ubxState = UBXSTATE_CKA; // switch to next state if all data was read
-			}
-			else // rx buffer overrun
-			{
-				ubxState = UBXSTATE_IDLE;
-			}
+			*ubxSp = INVALID; // mark invalid during buffer filling
+			if (msglen > (uint16_t)(ubxEp - ubxP)) ubxState = UBXSTATE_IDLE; // message does not fit into the buffer
+			else if (msglen == 0) ubxState = UBXSTATE_CKA; // no payload
+			else ubxState = UBXSTATE_DATA;
 			break;
 
 		case UBXSTATE_CKA:
@@ -384,6 +770,7 @@ void UBX_Parser()
 			if (c == cka) ubxState = UBXSTATE_CKB;
 			else
 			{
+				UbxStat.ChecksumError[ubxStat]++;
 				*ubxSp = INVALID;
 				ubxState = UBXSTATE_IDLE;
 			}
@@ -393,10 +780,26 @@ void UBX_Parser()
 			if (c == ckb)
 			{
 				*ubxSp = NEWDATA; // new data are valid
-				Update_GPSData(); //update GPS info respectively
+				if(ubxSlot != 0) // swap the buffers, the new message becomes the front buffer
+				{
+					ubxTmp = ubxSlot->pFront;
+					ubxSlot->pFront = ubxSlot->pBack;
+					ubxSlot->pBack = ubxTmp;
+				}
+				if(ubxClass == UBX_CLASS_AID) Aid_Store(ubxId, UbxAid.Data, ubxP - UbxAid.Data);
+				else if(ubxClass == UBX_CLASS_NAV)
+				{
+					Ubx_CheckTime = CountMilliseconds;
+					newfix = (GPSData.Status != NEWDATA);
+					Update_GPSData(ubxId); //update GPS info respectively
+					// return at once with a new fix, the rest is parsed in the next call
+					newfix &= (GPSData.Status == NEWDATA);
+					if(newfix) pend = pspan;
+				}
 			}
 			else
 			{	// if checksum not match then set data invalid
+				UbxStat.ChecksumError[ubxStat]++;
 				*ubxSp = INVALID;
 			}
 			ubxState = UBXSTATE_IDLE; // ready to parse new data
@@ -406,5 +809,196 @@ void UBX_Parser()
 			ubxState = UBXSTATE_IDLE;
 			break;
 
-	}}
+	}
+	}
+	span = pspan - pstart;
+	UbxStat.RxBytes += span;
+	Logging_UBXData(pstart, span); // copy the raw data for the card log before they are released
+	fifo_release(&rxFifo, span); // the parsed part of the span
+	if(newfix) break;
+	}
+}
+
+
+/********************************************************/
+/*            Send an UBX message to the receiver       */
+/********************************************************/
+void UBX_SendMessage(uint8_t class, uint8_t id, const uint8_t *pData, uint16_t len)
+{
+	uint8_t cka, ckb;
+
+	USART1_putc(UBX_SYNC1_CHAR);
+	USART1_putc(UBX_SYNC2_CHAR);
+	USART1_putc(class);
+	cka = class; ckb = cka;
+	USART1_putc(id);
+	cka += id; ckb += cka;
+	USART1_putc((uint8_t)len);
+	cka += (uint8_t)len; ckb += cka;
+	USART1_putc((uint8_t)(len>>8));
+	cka += (uint8_t)(len>>8); ckb += cka;
+	while(len--)
+	{
+		USART1_putc(*pData);
+		cka += *pData; ckb += cka;
+		pData++;
+	}
+	USART1_putc(cka);
+	USART1_putc(ckb);
+}
+
+/********************************************************/
+/*      Send the CFG message of a configuration step    */
+/********************************************************/
+uint8_t UBX_SendCfgStep(ubxCfgStep_t step, uint8_t PvtSupported)
+{
+	uint8_t payload[36];
+	uint8_t id, len, i;
+
+	for(i = 0; i < sizeof(payload); i++) payload[i] = 0;
+	switch(step)
+	{
+		case UBXCFG_PRT:
+		case UBXCFG_PRT_DEFAULT:
+			// port 1 (UART1), 8N1, UBX protocol in and out only
+			id = UBX_ID_CFG_PRT;
+			len = 20;
+			payload[0] = 1;
+			payload[4] = 0xD0; payload[5] = 0x08;
+			payload[8]  = (uint8_t)(USART1_BAUD);
+			payload[9]  = (uint8_t)(USART1_BAUD>>8);
+			payload[10] = (uint8_t)(USART1_BAUD>>16);
+			payload[12] = 0x01;
+			payload[14] = 0x01;
+			break;
+
+		case UBXCFG_RATE:
+			id = UBX_ID_CFG_RATE;
+			len = 6;
+			payload[0] = (uint8_t)(UBX_CFG_MEASRATE);
+			payload[1] = (uint8_t)(UBX_CFG_MEASRATE>>8);
+			payload[2] = 1; // every measurement is a navigation solution
+			payload[4] = 1; // align to GPS time
+			break;
+
+		case UBXCFG_NAV5:
+			id = UBX_ID_CFG_NAV5;
+			len = 36;
+			payload[0] = 0x01; // apply the dynamic model only
+			payload[2] = UBX_CFG_DYNMODEL;
+			break;
+
+		case UBXCFG_MSG_PVT:
+		case UBXCFG_MSG_SOL:
+		case UBXCFG_MSG_POSLLH:
+		case UBXCFG_MSG_VELNED:
+			id = UBX_ID_CFG_MSG;
+			len = 3;
+			payload[0] = UBX_CLASS_NAV;
+			switch(step)
+			{
+				case UBXCFG_MSG_PVT:	payload[1] = UBX_ID_PVT;	break;
+				case UBXCFG_MSG_SOL:	payload[1] = UBX_ID_SOL;	break;
+				case UBXCFG_MSG_POSLLH:	payload[1] = UBX_ID_POSLLH;	break;
+				default:				payload[1] = UBX_ID_VELNED;	break;
+			}
+			// one message per navigation solution
+			if((step == UBXCFG_MSG_PVT) || !PvtSupported) payload[2] = 1;
+			break;
+
+		default:
+			return(0);
+	}
+	UbxAck.Status = INVALID;
+	UbxNak.Status = INVALID;
+	UBX_SendMessage(UBX_CLASS_CFG, id, payload, len);
+	return(id);
+}
+
+/********************************************************/
+/*           Configuration of the receiver              */
+/********************************************************/
+// Has to be called periodically from the main loop until the configuration is done.
+// Every CFG message is repeated until it is acknowledged by the receiver.
+// If the receiver does not answer at USART1_BAUD, it is switched from
+// its default baud rate to USART1_BAUD.
+void UBX_Configure(void)
+{
+	static ubxCfgStep_t step = UBXCFG_PRT;
+	static uint8_t tries = 0, id = 0, sent = 0, rounds = 0;
+	static uint8_t PvtSupported = 1;
+	static uint16_t timeout = 0;
+	uint8_t ack = 0, nak = 0;
+
+	if(step == UBXCFG_DONE) return;
+
+	if(!sent) // send the message of the current step
+	{
+		if(step == UBXCFG_PRT_DEFAULT)
+		{	// wait until all data have been sent before the baud rate is changed
+			if(!USART1_TxComplete()) return;
+			USART1_SetBaudrate(UBX_CFG_BAUD_DEFAULT);
+		}
+		id = UBX_SendCfgStep(step, PvtSupported);
+		timeout = SetDelay(UBX_CFG_TIMEOUT);
+		sent = 1;
+		return;
+	}
+
+	if(step == UBXCFG_PRT_DEFAULT)
+	{	// the receiver answers at the new baud rate, therefore no ack is expected
+		if(!USART1_TxComplete()) return;
+		USART1_SetBaudrate(USART1_BAUD);
+		step = UBXCFG_PRT; // check the new baud rate
+		tries = 0;
+		sent = 0;
+		return;
+	}
+
+	// check the answer of the receiver
+	if((UbxAck.Status == NEWDATA) && (UbxAck.clsID == UBX_CLASS_CFG) && (UbxAck.msgID == id)) ack = 1;
+	if((UbxNak.Status == NEWDATA) && (UbxNak.clsID == UBX_CLASS_CFG) && (UbxNak.msgID == id)) nak = 1;
+
+	if(!ack && !nak)
+	{
+		if(!CheckDelay(timeout)) return; // wait for answer
+		if(++tries < UBX_CFG_RETRIES)
+		{
+			sent = 0; // repeat the message
+			return;
+		}
+		// no answer at all
+		if(step == UBXCFG_PRT)
+		{
+			if(++rounds > 2)
+			{
+				printf("\r\n UBX config: no receiver answer");
+				step = UBXCFG_DONE;
+				UbxConfigured = 1;
+			}
+			else step = UBXCFG_PRT_DEFAULT;
+			tries = 0;
+			sent = 0;
+			return;
+		}
+		printf("\r\n UBX config: no ack for cfg %02X", id);
+	}
+	else if(nak)
+	{
+		if(step == UBXCFG_MSG_PVT) PvtSupported = 0; // older receiver, use the legacy message set
+		else printf("\r\n UBX config: nak for cfg %02X", id);
+	}
+
+	// next step
+	UbxAck.Status = PROCESSED;
+	UbxNak.Status = PROCESSED;
+	tries = 0;
+	sent = 0;
+	if(step == UBXCFG_PRT) step = UBXCFG_RATE; // skip the default baud rate
+	else step++;
+	if(step == UBXCFG_DONE)
+	{
+		printf("\r\n UBX config: done, %s", PvtSupported ? "NAV-PVT" : "NAV-SOL/POSLLH/VELNED");
+		UbxConfigured = 1;
+	}
 }
@@ -51,7 +51,59 @@ typedef struct
 extern gps_data_t  GPSData;
 extern uint16_t CheckGPSOkay;
 
+// time stamps of a fix on its way to the radio in ms
+typedef struct
+{
+	uint16_t	RxTime;			// first byte of the epoch received by UART1
+	uint16_t	CheckTime;		// checksum of the last message of the epoch verified
+	uint16_t	PublishTime;	// fix published in GPSData
+	uint16_t	TxStartTime;	// follow me frame started on UART0
+	uint16_t	TxDoneTime;		// follow me frame shifted out
+} GPS_Stamp_t;
+
+// time stamps of the fix in GPSData
+extern GPS_Stamp_t GPSStamp;
+
+// index of the checksum error counters
+#define UBX_STAT_SOL		0
+#define UBX_STAT_POSLLH		1
+#define UBX_STAT_VELNED		2
+#define UBX_STAT_PVT		3
+#define UBX_STAT_ACK		4
+#define UBX_STAT_MSG_COUNT	5
+
+// health of the gps receive path, the rates are updated once per second
+typedef struct
+{
+	uint32_t	RxBytes;			// bytes received from the gps
+	uint16_t	RxRate;				// in bytes/s
+	uint16_t	FifoOverflow;		// bytes lost because the receive fifo was full
+	uint16_t	FifoHighwater;		// max. number of bytes in the receive fifo
+	uint16_t	SyncLoss;			// bytes skipped while searching for the next message
+	uint16_t	ChecksumError[UBX_STAT_MSG_COUNT]; // per message type
+	uint16_t	Epochs;				// navigation epochs assembled
+	uint8_t		EpochRate;			// in epochs/s
+	uint16_t	EpochIncomplete;	// epochs dropped because not all messages of the set were received
+	uint16_t	EpochMismatch;		// messages dropped because their iTOW does not belong to the current epoch
+	uint16_t	EpochInterval;		// last time between two epochs in ms
+	uint16_t	EpochJitter;		// max. - min. epoch interval within the last second in ms
+} __attribute__((packed)) UBX_Stat_t;
+
+extern UBX_Stat_t UbxStat;
+
+// aiding messages
+#define UBX_CLASS_AID		0x0B
+#define UBX_ID_AID_INI		0x01	// initial position and time
+#define UBX_ID_AID_ALM		0x30	// almanac of a satellite
+#define UBX_ID_AID_EPH		0x31	// ephemeris of a satellite
+#define UBX_AID_MAXLEN		104		// max. payload of an aiding message
+
+extern uint8_t UbxConfigured;	// the configuration of the receiver is finished
+
 void UBX_Init(void);
 void UBX_Parser(void);
+void UBX_Configure(void);
+void UBX_SendMessage(uint8_t class, uint8_t id, const uint8_t *pData, uint16_t len);
+void UBX_UpdateStat(void);
 
 #endif // _UBX_H